@@ -0,0 +1,221 @@
+"""Generates a local apt repository of synthetic packages and serves it over HTTP.
+
+The repository is built from a `PackageUniverse`, so the same universes that drive the
+simulated benchmarks can be resolved end to end with Docker. Every package is a real
+`.deb`; the executables of the universe's commands are shell scripts that read each of
+their required files in order and fail at the first one that is missing.
+
+"""
+
+import gzip
+import hashlib
+import io
+import os
+import shlex
+import tarfile
+import threading
+from email.utils import formatdate
+from functools import partial
+from http.server import SimpleHTTPRequestHandler, ThreadingHTTPServer
+from pathlib import Path
+from typing import Dict, Iterable, List, Optional, Tuple
+
+from deptective.simulation import PackageUniverse, SyntheticPackage
+
+# uninstallable packages depend on this package, which does not exist
+MISSING_DEPENDENCY = "deptective-synthetic-missing"
+# a fixed timestamp so that the generated repository is reproducible
+MTIME = 1_700_000_000
+
+
+def _tar(members: Iterable[Tuple[str, bytes, int]]) -> bytes:
+    buffer = io.BytesIO()
+    with gzip.GzipFile(fileobj=buffer, mode="wb", mtime=MTIME) as gz:
+        with tarfile.open(fileobj=gz, mode="w", format=tarfile.GNU_FORMAT) as tar:
+            directories = set()
+            for name, data, mode in members:
+                parents = Path(name).parents
+                for parent in reversed(list(parents)[:-1]):
+                    if parent not in directories:
+                        directories.add(parent)
+                        info = tarfile.TarInfo(f"./{parent}")
+                        info.type = tarfile.DIRTYPE
+                        info.mode = 0o755
+                        info.mtime = MTIME
+                        tar.addfile(info)
+                info = tarfile.TarInfo(f"./{name}")
+                info.size = len(data)
+                info.mode = mode
+                info.mtime = MTIME
+                tar.addfile(info, io.BytesIO(data))
+    return buffer.getvalue()
+
+
+def _ar(members: Iterable[Tuple[str, bytes]]) -> bytes:
+    out = io.BytesIO()
+    out.write(b"!<arch>\n")
+    for name, data in members:
+        header = (
+            f"{name:<16}{MTIME:<12}{0:<6}{0:<6}{0o100644:<8o}{len(data):<10}`\n"
+        ).encode("ascii")
+        assert len(header) == 60
+        out.write(header)
+        out.write(data)
+        if len(data) % 2:
+            out.write(b"\n")
+    return out.getvalue()
+
+
+def command_script(path: str, requires: Iterable[str]) -> bytes:
+    lines = ["#!/bin/sh", "set -e"]
+    lines.extend(f"cat {shlex.quote(r)} > /dev/null" for r in requires)
+    lines.append(f"echo {shlex.quote(Path(path).name)}: ok")
+    return ("\n".join(lines) + "\n").encode("utf-8")
+
+
+def build_deb(
+    universe: PackageUniverse, package: SyntheticPackage, arch: str
+) -> Tuple[bytes, Dict[str, str]]:
+    """Returns the contents of the package's .deb along with its control fields"""
+    data_members: List[Tuple[str, bytes, int]] = []
+    for path in package.files:
+        name = Path(path).name
+        if path.startswith("/usr/bin/") and name in universe.commands:
+            data = command_script(path, universe.commands[name].requires)
+            mode = 0o755
+        else:
+            data = f"{package.name}: {path}\n".encode("utf-8")
+            mode = 0o644
+        data_members.append((path.lstrip("/"), data, mode))
+    depends = list(package.depends)
+    if not package.installable:
+        depends.append(MISSING_DEPENDENCY)
+    control: Dict[str, str] = {
+        "Package": package.name,
+        "Version": "1.0",
+        "Architecture": arch,
+        "Maintainer": "Deptective Benchmarks <deptective@example.com>",
+        "Installed-Size": str(max(1, sum(len(d) for _, d, _ in data_members) // 1024)),
+        "Section": "misc",
+        "Priority": "optional",
+    }
+    if depends:
+        control["Depends"] = ", ".join(depends)
+    control["Description"] = f"synthetic package {package.name}"
+    control_file = "".join(f"{k}: {v}\n" for k, v in control.items()).encode("utf-8")
+    deb = _ar(
+        (
+            ("debian-binary", b"2.0\n"),
+            ("control.tar.gz", _tar((("control", control_file, 0o644),))),
+            ("data.tar.gz", _tar(data_members)),
+        )
+    )
+    return deb, control
+
+
+def build_repository(
+    universe: PackageUniverse,
+    root: Path,
+    suite: str = "noble",
+    arch: str = "amd64",
+    component: str = "main",
+) -> Path:
+    """Writes an apt repository for `universe` to `root` and returns `root`"""
+    stanzas: List[str] = []
+    contents: Dict[str, List[str]] = {}
+    for package in universe.packages.values():
+        deb, control = build_deb(universe, package, arch)
+        filename = f"pool/{component}/{package.name[0]}/{package.name}_1.0_{arch}.deb"
+        deb_path = root / filename
+        deb_path.parent.mkdir(parents=True, exist_ok=True)
+        deb_path.write_bytes(deb)
+        fields = dict(control)
+        description = fields.pop("Description")
+        fields["Filename"] = filename
+        fields["Size"] = str(len(deb))
+        fields["MD5sum"] = hashlib.md5(deb).hexdigest()
+        fields["SHA256"] = hashlib.sha256(deb).hexdigest()
+        fields["Description"] = description
+        stanzas.append("".join(f"{k}: {v}\n" for k, v in fields.items()))
+        for path in package.index:
+            contents.setdefault(path.lstrip("/"), []).append(
+                f"{control['Section']}/{package.name}"
+            )
+
+    dist = root / "dists" / suite
+    binary = dist / component / f"binary-{arch}"
+    binary.mkdir(parents=True, exist_ok=True)
+    packages_index = "\n".join(stanzas).encode("utf-8")
+    (binary / "Packages").write_bytes(packages_index)
+    (binary / "Packages.gz").write_bytes(gzip.compress(packages_index, mtime=MTIME))
+    contents_index = "".join(
+        f"{path:<60} {','.join(sorted(pkgs))}\n"
+        for path, pkgs in sorted(contents.items())
+    ).encode("utf-8")
+    (dist / f"Contents-{arch}.gz").write_bytes(
+        gzip.compress(contents_index, mtime=MTIME)
+    )
+
+    indexed = [
+        f"{component}/binary-{arch}/Packages",
+        f"{component}/binary-{arch}/Packages.gz",
+        f"Contents-{arch}.gz",
+    ]
+    checksums = []
+    for name in indexed:
+        data = (dist / name).read_bytes()
+        checksums.append(f" {hashlib.sha256(data).hexdigest()} {len(data)} {name}")
+    # the Release file only lists checksums and is not signed, so the sources entry for
+    # the repository must be marked `[trusted=yes]`
+    release = (
+        "Origin: Deptective\n"
+        "Label: Deptective Benchmarks\n"
+        f"Suite: {suite}\n"
+        f"Codename: {suite}\n"
+        f"Date: {formatdate(MTIME, usegmt=True)}\n"
+        f"Architectures: {arch}\n"
+        f"Components: {component}\n"
+        "SHA256:\n" + "\n".join(checksums) + "\n"
+    )
+    (dist / "Release").write_text(release)
+    return root
+
+
+class _QuietHandler(SimpleHTTPRequestHandler):
+    def log_message(self, format, *args):
+        pass
+
+
+class RepositoryServer:
+    """Serves a directory over HTTP on all interfaces so that containers can reach it"""
+
+    def __init__(self, root: Path, host: str = "0.0.0.0", port: int = 0):
+        self.server = ThreadingHTTPServer(
+            (host, port), partial(_QuietHandler, directory=str(root))
+        )
+        self._thread: Optional[threading.Thread] = None
+
+    @property
+    def port(self) -> int:
+        return self.server.server_address[1]
+
+    def __enter__(self) -> "RepositoryServer":
+        self._thread = threading.Thread(target=self.server.serve_forever, daemon=True)
+        self._thread.start()
+        return self
+
+    def __exit__(self, exc_type, exc_val, exc_tb):
+        self.server.shutdown()
+        self.server.server_close()
+
+
+def docker_host_address() -> str:
+    """Returns the address of the host on Docker's default bridge network"""
+    address = os.environ.get("DEPTECTIVE_BENCH_HOST")
+    if address:
+        return address
+    import docker
+
+    client = docker.from_env()
+    config = client.networks.get("bridge").attrs["IPAM"]["Config"]
+    return config[0]["Gateway"]
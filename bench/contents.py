@@ -0,0 +1,80 @@
+"""Package database sources for the cache benchmarks.
+
+Set `DEPTECTIVE_BENCH_CONTENTS` to the path of a real, gzipped APT Contents file to
+benchmark with it; otherwise a synthetic Contents file of `DEPTECTIVE_BENCH_CACHE_ROWS`
+paths (default 200,000) with a similar shape is generated. The real Ubuntu databases have
+several million paths each.
+
+"""
+
+import gzip
+import os
+import random
+from pathlib import Path
+from typing import FrozenSet, Iterator, List, Optional, Tuple
+
+from deptective.apt import iter_contents
+
+DEFAULT_ROWS = 200_000
+
+EXTENSIONS = ("py", "h", "png", "svg", "mo", "html", "gz", "json", "pm", "rb")
+
+
+def _package_name(rng: random.Random) -> str:
+    syllables = ("lib", "py", "gir", "node", "ruby", "tex", "font", "x", "gnome", "kde")
+    name = rng.choice(syllables) + "".join(
+        rng.choice("abcdefghijklmnopqrstuvwxyz") for _ in range(rng.randint(3, 9))
+    )
+    if rng.random() < 0.3:
+        name += f"-{rng.choice(('dev', 'doc', 'data', 'common', 'bin'))}"
+    return name
+
+
+def synthetic_contents(
+    rows: int = DEFAULT_ROWS, seed: int = 0
+) -> Iterator[Tuple[str, FrozenSet[str]]]:
+    """Yields `rows` synthetic paths along with the packages that provide them"""
+    rng = random.Random(seed)
+    emitted = 0
+    while emitted < rows:
+        package = _package_name(rng)
+        paths: List[str] = [
+            f"usr/share/doc/{package}/copyright",
+            f"usr/share/doc/{package}/changelog.Debian.gz",
+        ]
+        kind = rng.random()
+        if kind < 0.25:
+            paths.append(f"usr/lib/x86_64-linux-gnu/{package}.so.{rng.randint(0, 9)}")
+        elif kind < 0.35:
+            paths.append(f"usr/bin/{package}")
+            paths.append(f"usr/share/man/man1/{package}.1.gz")
+        for i in range(int(rng.expovariate(1 / 40))):
+            depth = "/".join(
+                rng.choice(("data", "icons", "scalable", "lib", "modules", "locale"))
+                for _ in range(rng.randint(0, 3))
+            )
+            directory = f"usr/share/{package}/{depth}".rstrip("/")
+            paths.append(f"{directory}/file{i}.{rng.choice(EXTENSIONS)}")
+        for path in paths:
+            if emitted == rows:
+                return
+            providers = {package}
+            if rng.random() < 0.02:
+                # a few paths are provided by more than one package
+                providers.add(_package_name(rng))
+            yield path, frozenset(providers)
+            emitted += 1
+
+
+def contents_source() -> Tuple[str, Iterator[Tuple[str, FrozenSet[str]]]]:
+    """Returns a description of the configured source along with its paths"""
+    path: Optional[str] = os.environ.get("DEPTECTIVE_BENCH_CONTENTS")
+    if path:
+
+        def read() -> Iterator[Tuple[str, FrozenSet[str]]]:
+            with gzip.open(Path(path), "rb") as gz:
+                yield from iter_contents(gz)  # type: ignore
+
+        return Path(path).name, read()
+    rows = int(os.environ.get("DEPTECTIVE_BENCH_CACHE_ROWS", DEFAULT_ROWS))
+    return f"synthetic-{rows}", synthetic_contents(rows)
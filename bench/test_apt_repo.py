@@ -0,0 +1,47 @@
+"""Sanity checks of the synthetic apt repository that do not require Docker"""
+
+import gzip
+import shutil
+import subprocess
+
+import pytest
+
+from deptective.apt import parse_release_checksum
+from deptective.logs import file_sha256
+
+from .apt_repo import MISSING_DEPENDENCY, build_repository
+from .test_end_to_end import hello_universe
+
+
+def test_repository(tmp_path):
+    root = build_repository(hello_universe(), tmp_path)
+    dist = root / "dists" / "noble"
+    with gzip.open(dist / "Contents-amd64.gz", "rt") as f:
+        contents = dict(line.split() for line in f)
+    # the decoy is listed in the index even though it does not ship the file
+    assert contents["usr/share/synth-greeting/greeting"] == (
+        "misc/synth-greeting,misc/synth-greeting-doc"
+    )
+    assert contents["usr/bin/synth-hello"] == "misc/synth-hello"
+    release = (dist / "Release").read_text()
+    assert parse_release_checksum(release, "Contents-amd64.gz") == file_sha256(
+        dist / "Contents-amd64.gz"
+    )
+    assert MISSING_DEPENDENCY not in (dist / "main/binary-amd64/Packages").read_text()
+
+
+@pytest.mark.skipif(shutil.which("dpkg-deb") is None, reason="requires dpkg-deb")
+def test_deb(tmp_path):
+    root = build_repository(hello_universe(), tmp_path / "repo")
+    deb = next((root / "pool").glob("*/s/synth-hello_*.deb"))
+    info = subprocess.run(
+        ["dpkg-deb", "--field", str(deb), "Package"], capture_output=True, check=True
+    )
+    assert info.stdout.strip() == b"synth-hello"
+    subprocess.run(["dpkg-deb", "-x", str(deb), str(tmp_path / "x")], check=True)
+    script = tmp_path / "x" / "usr" / "bin" / "synth-hello"
+    assert script.stat().st_mode & 0o111
+    result = subprocess.run([str(script)], capture_output=True)
+    # the greeting is not installed, so the command fails trying to read it
+    assert result.returncode != 0
+    assert b"/usr/share/synth-greeting/greeting" in result.stderr
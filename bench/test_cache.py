@@ -0,0 +1,180 @@
+"""Microbenchmarks of every registered `Cache` backend.
+
+Each backend is built from the same package database (see `contents.py`) and measured
+for build time, on-disk size, cold and warm open time, single and batched lookup latency,
+and resident memory. Sizes and memory are reported in each benchmark's `extra_info`.
+
+"""
+
+import itertools
+import os
+import random
+import resource
+from contextlib import contextmanager
+from pathlib import Path
+from typing import Dict, FrozenSet, Iterator, List, Tuple
+
+import pytest
+
+import deptective.cache
+from deptective.apt import Apt
+from deptective.cache import CACHE_BACKENDS, Cache
+from deptective.package_manager import PackagingConfig
+
+from .contents import contents_source
+
+PACKAGE_MANAGER = Apt(PackagingConfig(os="ubuntu", os_version="noble", arch="amd64"))
+SAMPLE_SIZE = 1_000
+
+
+@contextmanager
+def cache_dir(path: Path):
+    with pytest.MonkeyPatch.context() as mp:
+        mp.setattr(deptective.cache, "CACHE_DIR", path)
+        yield
+
+
+def disk_usage(path: Path) -> int:
+    return sum(p.stat().st_size for p in path.rglob("*") if p.is_file())
+
+
+def evict_page_cache(path: Path):
+    for p in path.rglob("*"):
+        if p.is_file():
+            fd = os.open(p, os.O_RDONLY)
+            try:
+                os.posix_fadvise(fd, 0, 0, os.POSIX_FADV_DONTNEED)
+            finally:
+                os.close(fd)
+
+
+def rss_bytes() -> int:
+    with open("/proc/self/statm") as f:
+        return int(f.read().split()[1]) * resource.getpagesize()
+
+
+class Sampled:
+    """Wraps the package database, keeping an evenly spaced sample of its paths"""
+
+    def __init__(self, packages: Iterator[Tuple[str, FrozenSet[str]]]):
+        self.packages = packages
+        self.sample: List[str] = []
+        self.rows: int = 0
+
+    def __iter__(self) -> Iterator[Tuple[str, FrozenSet[str]]]:
+        rng = random.Random(0)
+        for filename, packages in self.packages:
+            self.rows += 1
+            # reservoir sampling
+            if len(self.sample) < SAMPLE_SIZE:
+                self.sample.append(filename)
+            else:
+                i = rng.randrange(self.rows)
+                if i < SAMPLE_SIZE:
+                    self.sample[i] = filename
+            yield filename, packages
+
+
+class Workspace:
+    def __init__(self, backend: str, path: Path):
+        self.backend: str = backend
+        self.cache_class = CACHE_BACKENDS[backend]
+        self.path: Path = path
+        self.sample: List[str] = []
+        self.info: Dict[str, object] = {}
+
+    def build(self):
+        for p in self.path.glob("*"):
+            p.unlink()
+        name, packages = contents_source()
+        sampled = Sampled(packages)
+        with cache_dir(self.path):
+            cache = self.cache_class.from_iterable(PACKAGE_MANAGER, sampled)
+            cache.save()
+            cache.close()
+        self.sample = sampled.sample
+        self.info = {
+            "source": name,
+            "rows": sampled.rows,
+            "disk_bytes": disk_usage(self.path),
+        }
+
+    @property
+    def built(self) -> bool:
+        return bool(self.sample)
+
+    def open(self) -> Cache:
+        with cache_dir(self.path):
+            return self.cache_class.from_disk(PACKAGE_MANAGER)
+
+
+@pytest.fixture(scope="module", params=sorted(CACHE_BACKENDS))
+def workspace(request, tmp_path_factory) -> Workspace:
+    return Workspace(request.param, tmp_path_factory.mktemp(request.param))
+
+
+@pytest.fixture
+def built(workspace) -> Workspace:
+    if not workspace.built:
+        workspace.build()
+    return workspace
+
+
+def test_build(benchmark, workspace):
+    benchmark.pedantic(workspace.build, rounds=1, iterations=1)
+    benchmark.extra_info.update(workspace.info)
+
+
+@pytest.mark.parametrize("cold", (True, False), ids=("cold", "warm"))
+def test_open(benchmark, built, cold):
+    def setup():
+        if cold:
+            evict_page_cache(built.path)
+
+    def open_and_lookup():
+        cache = built.open()
+        try:
+            cache[built.sample[0]]
+        finally:
+            cache.close()
+
+    benchmark.pedantic(open_and_lookup, setup=setup, rounds=10, iterations=1)
+    benchmark.extra_info.update(built.info)
+
+
+@pytest.mark.parametrize("hit", (True, False), ids=("hit", "miss"))
+def test_lookup(benchmark, built, hit):
+    if hit:
+        paths = itertools.cycle(built.sample)
+    else:
+        paths = itertools.cycle(f"{p}.missing" for p in built.sample)
+    rss_before = rss_bytes()
+    cache = built.open()
+    try:
+        benchmark(lambda: cache[next(paths)])
+        benchmark.extra_info["rss_delta_bytes"] = rss_bytes() - rss_before
+    finally:
+        cache.close()
+    benchmark.extra_info.update(built.info)
+
+
+def test_batched_lookup(benchmark, built):
+    cache = built.open()
+    try:
+        found = benchmark(cache.lookup_many, built.sample)
+        assert all(found[p] for p in built.sample)
+        benchmark.extra_info["batch_size"] = len(built.sample)
+    finally:
+        cache.close()
+    benchmark.extra_info.update(built.info)
+
+
+def test_lookup_consistency(built):
+    """Not a benchmark: every backend must agree with single lookups"""
+    cache = built.open()
+    try:
+        batched = cache.lookup_many(built.sample)
+        for path in built.sample:
+            assert cache[path] == batched[path]
+    finally:
+        cache.close()
@@ -0,0 +1,123 @@
+"""End-to-end benchmarks of full resolutions against a local synthetic apt repository.
+
+These require Docker and are skipped without it. The repository is served from the host,
+and deptective runs in a subprocess with its own cache directory, so neither the
+package database nor any Docker image of a normal installation is touched. Only the
+one-time pull of the Ubuntu base image (and of strace while building it) needs the
+Internet.
+
+"""
+
+import os
+import shutil
+import subprocess
+import sys
+import time
+from pathlib import Path
+
+import pytest
+
+from deptective.simulation import PackageUniverse, SyntheticCommand, SyntheticPackage
+
+from .apt_repo import RepositoryServer, build_repository, docker_host_address
+
+SUITE = "noble"
+ARCH = "amd64"
+
+
+def hello_universe() -> PackageUniverse:
+    return PackageUniverse(
+        [
+            SyntheticPackage("synth-hello", files=("/usr/bin/synth-hello",)),
+            SyntheticPackage(
+                "synth-greeting", files=("/usr/share/synth-greeting/greeting",)
+            ),
+            SyntheticPackage(
+                "synth-greeting-doc",
+                indexed_files=("/usr/share/synth-greeting/greeting",),
+            ),
+        ],
+        [SyntheticCommand("synth-hello", ("/usr/share/synth-greeting/greeting",))],
+    )
+
+
+FIXTURES = {
+    "hello": (hello_universe, ["synth-hello"]),
+    "generated-depth2": (
+        lambda: PackageUniverse.generate(packages=50, depth=2, providers=2),
+        ["app"],
+    ),
+    "generated-depth4": (
+        lambda: PackageUniverse.generate(packages=200, depth=4),
+        ["app"],
+    ),
+}
+
+
+def docker_available() -> bool:
+    try:
+        import docker
+
+        docker.from_env().ping()
+    except Exception:
+        return False
+    return True
+
+
+pytestmark = pytest.mark.skipif(not docker_available(), reason="requires Docker")
+
+
+@pytest.fixture(scope="module", params=sorted(FIXTURES))
+def repository(request, tmp_path_factory):
+    make_universe, command = FIXTURES[request.param]
+    root = build_repository(
+        make_universe(), tmp_path_factory.mktemp("repo"), suite=SUITE, arch=ARCH
+    )
+    cache_home = tmp_path_factory.mktemp("cache")
+    workdir = tmp_path_factory.mktemp("workdir")
+    with RepositoryServer(root) as server:
+        env = dict(os.environ)
+        env["XDG_CACHE_HOME"] = str(cache_home)
+        env["DEPTECTIVE_APT_MIRROR"] = f"http://127.0.0.1:{server.port}"
+        env["DEPTECTIVE_APT_SOURCES"] = (
+            f"deb [trusted=yes] http://{docker_host_address()}:{server.port} {SUITE} main"
+        )
+        yield env, workdir, command
+    shutil.rmtree(root, ignore_errors=True)
+
+
+def deptective(env, workdir: Path, *args: str) -> subprocess.CompletedProcess:
+    return subprocess.run(
+        [
+            sys.executable,
+            "-m",
+            "deptective",
+            "--operating-system",
+            "ubuntu",
+            "--release",
+            SUITE,
+            "--arch",
+            ARCH,
+            *args,
+        ],
+        env=env,
+        cwd=workdir,
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+    )
+
+
+def test_resolution(benchmark, repository):
+    env, workdir, command = repository
+    # build the package cache and the base image outside of the timed runs
+    result = deptective(env, workdir, "--rebuild")
+    assert result.returncode == 0, result.stderr.decode("utf-8", "replace")
+
+    def resolve():
+        start = time.perf_counter()
+        result = deptective(env, workdir, "--quiet", *command)
+        assert result.returncode == 0, result.stderr.decode("utf-8", "replace")
+        return result.stdout, time.perf_counter() - start
+
+    stdout, _ = benchmark.pedantic(resolve, rounds=3, iterations=1, warmup_rounds=1)
+    benchmark.extra_info["sbom"] = stdout.decode("utf-8").strip()
@@ -0,0 +1,72 @@
+"""Benchmarks of the dependency search against synthetic package universes.
+
+Run with `make bench`, or `pytest bench/` with pytest-benchmark installed. In addition
+to wall time, each benchmark reports the number of search nodes explored, the number of
+results, and the peak memory allocated during the search in its `extra_info`.
+
+"""
+
+import logging
+import tracemalloc
+
+import pytest
+
+from deptective import apt  # noqa: F401
+from deptective.simulation import PackageUniverse, SimulatedSBOMGenerator
+
+SCALES = [
+    (1_000, 2),
+    (1_000, 6),
+    (10_000, 4),
+    (10_000, 8),
+    (50_000, 4),
+    (50_000, 8),
+]
+
+
+@pytest.fixture(autouse=True)
+def quiet():
+    # every decoy that fails to install is logged as a warning
+    logging.disable(logging.WARNING)
+    yield
+    logging.disable(logging.NOTSET)
+
+
+@pytest.fixture(scope="module", params=SCALES, ids=lambda p: f"{p[0]}pkgs-depth{p[1]}")
+def universe(request) -> PackageUniverse:
+    packages, depth = request.param
+    return PackageUniverse.generate(packages=packages, depth=depth, providers=2)
+
+
+def search(universe: PackageUniverse, num_results: int, info: dict):
+    generator = SimulatedSBOMGenerator(universe)
+    tracemalloc.start()
+    try:
+        results = []
+        for sbom in generator.main("app"):
+            results.append(sbom)
+            if len(results) == num_results:
+                break
+        _, peak = tracemalloc.get_traced_memory()
+    finally:
+        tracemalloc.stop()
+    info["nodes_explored"] = generator.nodes_explored
+    info["results"] = len(results)
+    info["peak_memory_bytes"] = peak
+    return results
+
+
+def test_first_result(benchmark, universe):
+    results = benchmark.pedantic(
+        search, args=(universe, 1, benchmark.extra_info), rounds=3, iterations=1
+    )
+    assert len(results) == 1
+
+
+def test_all_results(benchmark, universe):
+    if len(universe.commands["app"].requires) > 6:
+        pytest.skip("enumerating every result of the deepest universes takes minutes")
+    results = benchmark.pedantic(
+        search, args=(universe, 0, benchmark.extra_info), rounds=1, iterations=1
+    )
+    assert results
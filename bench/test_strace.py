@@ -0,0 +1,63 @@
+"""Throughput benchmarks of the strace parser over the corpus in `test/corpus`.
+
+Each benchmark parses every line of one trace and reports its throughput in MB/s and
+lines/s in its `extra_info`.
+
+"""
+
+import gzip
+from pathlib import Path
+from typing import Callable, Dict, List
+
+import pytest
+
+from deptective.strace import ParseError, lazy_parse_paths, parse_strace_log_line
+
+CORPUS_DIR = Path(__file__).absolute().parent.parent / "test" / "corpus"
+TRACES = sorted(p.name[: -len(".strace.gz")] for p in CORPUS_DIR.glob("*.strace.gz"))
+
+
+def read_trace(name: str) -> List[str]:
+    with gzip.open(CORPUS_DIR / f"{name}.strace.gz", "rt", encoding="utf-8") as f:
+        return f.readlines()
+
+
+def parse_lines(lines: List[str]):
+    for line in lines:
+        try:
+            _, args, _ = parse_strace_log_line(line)
+            for _ in args:
+                pass
+        except ParseError:
+            pass
+
+
+def parse_paths(lines: List[str]):
+    for line in lines:
+        try:
+            for _ in lazy_parse_paths(line):
+                pass
+        except ParseError:
+            pass
+
+
+PARSERS: Dict[str, Callable[[List[str]], None]] = {
+    "parse_strace_log_line": parse_lines,
+    "lazy_parse_paths": parse_paths,
+}
+
+
+@pytest.mark.parametrize("parser", sorted(PARSERS))
+@pytest.mark.parametrize("trace", TRACES)
+def test_parse(benchmark, trace: str, parser: str):
+    lines = read_trace(trace)
+    size = sum(len(line.encode("utf-8")) for line in lines)
+    benchmark.pedantic(PARSERS[parser], args=(lines,), rounds=5, iterations=1)
+    benchmark.extra_info["bytes"] = size
+    benchmark.extra_info["lines"] = len(lines)
+    if benchmark.stats is None:
+        # nothing was timed, e.g., with `--benchmark-disable`
+        return
+    mean = benchmark.stats.stats.mean
+    benchmark.extra_info["mb_per_second"] = size / mean / 1_000_000
+    benchmark.extra_info["lines_per_second"] = len(lines) / mean
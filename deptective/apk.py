@@ -0,0 +1,268 @@
+import logging
+import os
+import re
+import tarfile
+from html.parser import HTMLParser
+from typing import (
+    BinaryIO,
+    Dict,
+    FrozenSet,
+    Iterable,
+    Iterator,
+    List,
+    Optional,
+    Set,
+    Tuple,
+    Type,
+    TypeVar,
+)
+from urllib.error import HTTPError
+from urllib.request import urlopen
+
+from rich.progress import Progress
+
+from .cache import CACHE_DIR
+from .containers import DockerContainer
+from .exceptions import PackageDatabaseNotFoundError, PackageResolutionError
+from .logs import DownloadWithProgress, iterative_readlines
+from .package_manager import PackageManager, PackagingConfig, sources_digest
+
+logger = logging.getLogger(__name__)
+
+DOWNLOAD_DIR = CACHE_DIR / "downloads"
+
+DEFAULT_MIRROR = "https://dl-cdn.alpinelinux.org/alpine"
+# the mirror from which the package indexes are downloaded
+MIRROR_ENV = "DEPTECTIVE_APK_MIRROR"
+REPOSITORIES: Tuple[str, ...] = ("main", "community")
+
+# the paths at which Alpine installs the files named by each kind of `provides` entry
+PROVIDES_PATHS: Dict[str, Tuple[str, ...]] = {
+    "cmd": ("bin/{}", "sbin/{}", "usr/bin/{}", "usr/sbin/{}"),
+    "so": ("lib/{}", "usr/lib/{}"),
+    "pc": ("usr/lib/pkgconfig/{}.pc", "usr/share/pkgconfig/{}.pc"),
+}
+
+
+def apk_mirror() -> str:
+    return os.environ.get(MIRROR_ENV, DEFAULT_MIRROR).rstrip("/")
+
+
+T = TypeVar("T")
+
+
+class ApkResolutionError(PackageResolutionError):
+    pass
+
+
+class ApkDatabaseNotFoundError(PackageDatabaseNotFoundError):
+    pass
+
+
+class AlpineMirrorParser(HTMLParser):
+    def __init__(self):
+        super().__init__()
+        self.subdirectories: set[str] = set()
+
+    def handle_starttag(self, tag, attrs):
+        if tag == "a" and attrs:
+            is_href, url = attrs[0]
+            if (
+                is_href == "href"
+                and url.endswith("/")
+                and not url.startswith(("/", "."))
+            ):
+                self.subdirectories.add(url[:-1])
+
+
+def iter_apkindex(stream: BinaryIO) -> Iterator[Tuple[str, List[str]]]:
+    """Parses an uncompressed APKINDEX file into package names and what each provides"""
+    package: Optional[str] = None
+    provides: List[str] = []
+    for line in iterative_readlines(stream):
+        text = line.decode("utf-8").rstrip("\n")
+        if not text:
+            if package is not None:
+                yield package, provides
+            package, provides = None, []
+        elif text.startswith("P:"):
+            package = text[2:]
+        elif text.startswith("p:"):
+            provides = text[2:].split()
+    if package is not None:
+        yield package, provides
+
+
+def provided_paths(provides: str) -> Tuple[str, ...]:
+    """Returns the paths of the files named by an APKINDEX `provides` entry such as
+    `cmd:curl=8.9.1-r0`, `so:libz.so.1=1.3.1`, or `pc:zlib=1.3.1`"""
+    kind, _, name = provides.partition(":")
+    name = re.split(r"[=<>~]", name, maxsplit=1)[0]
+    if not name or kind not in PROVIDES_PATHS:
+        return ()
+    return tuple(path.format(name) for path in PROVIDES_PATHS[kind])
+
+
+def iter_apkindex_paths(
+    stream: BinaryIO,
+) -> Iterator[Tuple[str, str]]:
+    """Yields every path named by the `provides` entries of an APKINDEX along with the
+    package providing it"""
+    for package, provides in iter_apkindex(stream):
+        for p in provides:
+            for path in provided_paths(p):
+                yield path, package
+
+
+class Apk(PackageManager):
+    """Alpine's package manager.
+
+    Alpine does not publish a complete index of the files in its packages, so the
+    package database is built from the executables, shared libraries, and pkg-config
+    files that each package declares it provides in the APKINDEX of its repository.
+
+    """
+
+    NAME = "apk"
+
+    @property
+    def repository_version(self) -> str:
+        if self.config.os_version == "edge":
+            return "edge"
+        # Alpine's repositories are per minor release (e.g., 3.20.3 uses v3.20)
+        return f"v{'.'.join(self.config.os_version.split('.')[:2])}"
+
+    @property
+    def image_version(self) -> str:
+        return self.repository_version.lstrip("v")
+
+    def update(self, container: DockerContainer) -> Tuple[int, bytes]:
+        return container.exec_run("apk update")
+
+    def install_command(self, packages: Iterable[str]) -> str:
+        return f"apk add {' '.join(packages)}"
+
+    def installed_packages(
+        self, container: DockerContainer
+    ) -> Optional[FrozenSet[str]]:
+        retval, output = container.exec_run("apk info -q")
+        if retval != 0:
+            return None
+        return frozenset(output.decode("utf-8").split())
+
+    def package_files(
+        self, container: DockerContainer, packages: Iterable[str]
+    ) -> Optional[FrozenSet[str]]:
+        packages = tuple(packages)
+        if not packages:
+            return frozenset()
+        retval, output = container.exec_run(f"apk info -q -L {' '.join(packages)}")
+        if retval != 0:
+            return None
+        # apk lists the paths relative to the root, one package after another
+        return frozenset(
+            f"/{line.strip()}"
+            for line in output.decode("utf-8").splitlines()
+            if line.strip() and not line.rstrip().endswith(" contains:")
+        )
+
+    @classmethod
+    def versions(cls: Type[T]) -> Iterator[T]:
+        """Yields all possible configurations"""
+        mirror = apk_mirror()
+        parser = AlpineMirrorParser()
+        with urlopen(f"{mirror}/") as request:
+            parser.feed(request.read().decode("utf-8"))
+        for version in sorted(parser.subdirectories):
+            if version != "edge" and not re.fullmatch(r"v\d+\.\d+", version):
+                continue
+            sub_parser = AlpineMirrorParser()
+            with urlopen(f"{mirror}/{version}/main/") as sub_request:
+                sub_parser.feed(sub_request.read().decode("utf-8"))
+            for arch in sub_parser.subdirectories:
+                yield cls(  # type: ignore
+                    PackagingConfig(
+                        os="alpine",
+                        os_version=version.lstrip("v"),
+                        arch=arch,
+                    )
+                )
+
+    def sources_id(self) -> Optional[str]:
+        if apk_mirror() == DEFAULT_MIRROR:
+            return None
+        return sources_digest(apk_mirror())
+
+    def index_url(self, repository: str) -> str:
+        return (
+            f"{apk_mirror()}/{self.repository_version}/{repository}/"
+            f"{self.config.arch}/APKINDEX.tar.gz"
+        )
+
+    def iter_packages(
+        self, progress: Optional[Progress] = None
+    ) -> Iterator[Tuple[str, FrozenSet[str]]]:
+        """
+        Downloads the APKINDEX of every repository and presents it as an iterator.
+        """
+        providers: Dict[str, Set[str]] = {}
+        for repository in REPOSITORIES:
+            url = self.index_url(repository)
+            logger.info(
+                f"Downloading {url}\n"
+                "This is a one-time download and may take a few minutes."
+            )
+            config_name = self.with_sources_id(
+                f"{self.NAME}_{self.config.os}_{self.repository_version}"
+            )
+            try:
+                download = DownloadWithProgress(
+                    url,
+                    progress=progress,
+                    filename=f"{self.repository_version}/{repository}/APKINDEX.tar.gz",
+                    destination=DOWNLOAD_DIR
+                    / f"{config_name}_{repository}_APKINDEX-{self.config.arch}.tar.gz",
+                )
+                with download as p, tarfile.open(fileobj=p, mode="r:gz") as tar:
+                    index = tar.extractfile("APKINDEX")
+                    if index is None:
+                        raise ApkResolutionError(f"{url} does not contain an APKINDEX")
+                    for path, package in iter_apkindex_paths(index):  # type: ignore
+                        providers.setdefault(path, set()).add(package)
+            except HTTPError as e:
+                if e.code == 404:
+                    raise ApkDatabaseNotFoundError(
+                        f"Received an HTTP 404 error when trying to download the package "
+                        f"index for {self.config.os}:{self.config.os_version}-"
+                        f"{self.config.arch} from {url}"
+                    )
+                raise ApkResolutionError(
+                    f"Error trying to download the package index for "
+                    f"{self.config.os}:{self.config.os_version}-{self.config.arch} from "
+                    f"{url}: {e!s}"
+                )
+        for path, packages in providers.items():
+            yield path, frozenset(packages)
+
+    def dockerfile(self) -> str:
+        # strace is copied out of a builder stage along with the libraries it needs (so
+        # that installing it does not count as a dependency of the traced command) and
+        # run through musl's dynamic linker so that those libraries are only visible to
+        # strace itself
+        return f"""FROM alpine:{self.image_version} AS builder
+RUN apk add --no-cache strace
+RUN mkdir -p /deptective/lib && \\
+    cp /usr/bin/strace /deptective/strace && \\
+    ldd /usr/bin/strace | awk '/=>/ {{ print $3 }}' | xargs -r -I{{}} cp {{}} /deptective/lib/ && \\
+    cp /lib/ld-musl-*.so.1 /deptective/lib/ld-musl.so.1
+
+FROM alpine:{self.image_version}
+RUN mkdir /src/
+COPY --from=builder /deptective /opt/deptective
+RUN printf '#!/bin/sh\\nexec /opt/deptective/lib/ld-musl.so.1 --library-path /opt/deptective/lib /opt/deptective/strace "$@"\\n' > /usr/bin/strace-native && \\
+    chmod +x /usr/bin/strace-native
+COPY deptective-strace /usr/bin/deptective-strace
+COPY deptective-files-exist /usr/bin/deptective-files-exist
+
+ENTRYPOINT ["/usr/bin/deptective-strace"]
+"""
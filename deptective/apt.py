@@ -1,24 +1,85 @@
 import gzip
 import logging
+import lzma
+import os
 import re
+import shlex
+import shutil
+import subprocess
+from contextlib import contextmanager
 from html.parser import HTMLParser
+from pathlib import Path
 from typing import (
+    BinaryIO,
     FrozenSet,
+    Iterable,
     Iterator,
+    List,
+    Optional,
+    Set,
     Tuple,
     Type,
     TypeVar,
 )
-from urllib.error import HTTPError
+from urllib.error import HTTPError, URLError
 from urllib.request import urlopen
 
+from rich.progress import Progress
+
+from .cache import CACHE_DIR
 from .containers import DockerContainer
 from .exceptions import PackageDatabaseNotFoundError, PackageResolutionError
 from .logs import DownloadWithProgress, iterative_readlines
-from .package_manager import PackageManager, PackagingConfig
+from .package_manager import PackageManager, PackagingConfig, sources_digest
 
 logger = logging.getLogger(__name__)
 
+DOWNLOAD_DIR = CACHE_DIR / "downloads"
+
+DEFAULT_MIRROR = "http://security.ubuntu.com/ubuntu"
+# the mirror from which the package database is downloaded
+MIRROR_ENV = "DEPTECTIVE_APT_MIRROR"
+# newline-separated `sources.list` entries that replace the base image's apt sources
+SOURCES_ENV = "DEPTECTIVE_APT_SOURCES"
+# the directory holding apt's package lists, including the Contents indexes fetched by
+# apt-file; set to an empty string to always download the package database instead
+LISTS_ENV = "DEPTECTIVE_APT_LISTS"
+DEFAULT_LISTS_DIR = Path("/var/lib/apt/lists")
+
+# maps `platform.machine()` to the corresponding dpkg architecture
+DPKG_ARCHITECTURES = {
+    "x86_64": "amd64",
+    "amd64": "amd64",
+    "aarch64": "arm64",
+    "arm64": "arm64",
+    "armv7l": "armhf",
+    "i386": "i386",
+    "i686": "i386",
+    "ppc64le": "ppc64el",
+    "s390x": "s390x",
+    "riscv64": "riscv64",
+}
+
+
+def apt_mirror() -> str:
+    return os.environ.get(MIRROR_ENV, DEFAULT_MIRROR).rstrip("/")
+
+
+def apt_sources() -> Optional[str]:
+    sources = os.environ.get(SOURCES_ENV, "").strip()
+    if not sources:
+        return None
+    return sources
+
+
+def apt_lists_dir() -> Optional[Path]:
+    lists = os.environ.get(LISTS_ENV)
+    if lists is None:
+        return DEFAULT_LISTS_DIR
+    elif not lists.strip():
+        return None
+    return Path(lists)
+
 
 T = TypeVar("T")
 
@@ -55,21 +116,140 @@ class UbuntuDistParser(HTMLParser):
         pass
 
 
+def parse_release_checksum(release: str, path: str) -> Optional[str]:
+    """Returns the SHA256 digest of `path` from the contents of an APT Release file"""
+    in_sha256 = False
+    for line in release.splitlines():
+        if not line.startswith(" "):
+            in_sha256 = line.strip() == "SHA256:"
+            continue
+        elif in_sha256:
+            fields = line.split()
+            if len(fields) == 3 and fields[2] == path:
+                return fields[0]
+    return None
+
+
+CONTENTS_PATTERN = re.compile(r"(\S+)\s+(\S.*)")
+
+
+def iter_contents(stream: BinaryIO) -> Iterator[Tuple[str, FrozenSet[str]]]:
+    """Parses an uncompressed APT Contents file into paths and the packages providing them"""
+    for line in iterative_readlines(stream):
+        m = CONTENTS_PATTERN.match(line.decode("utf-8"))
+        if not m:
+            raise ValueError(f"Unexpected line: {line!r}")
+        filename = m.group(1)
+        packages = frozenset(
+            pkg.split("/")[-1].strip() for pkg in m.group(2).split(",")
+        )
+        yield filename, packages
+
+
+# e.g., archive.ubuntu.com_ubuntu_dists_noble-updates_main_Contents-amd64.lz4
+LOCAL_CONTENTS_PATTERN = re.compile(
+    r".+_dists_(?P<suite>[^_]+)_(?:[^_]+_)*Contents-(?P<arch>[^_.]+)"
+    r"(?:\.(?P<compression>gz|lz4|xz))?"
+)
+
+
+def local_contents_files(lists_dir: Path, os_version: str, arch: str) -> List[Path]:
+    """
+    Returns the Contents indexes in an apt lists directory for every pocket of a release.
+
+    Returns an empty list unless the release pocket itself is present, since the
+    updates and security pockets only list the packages that changed.
+    """
+    if not lists_dir.is_dir():
+        return []
+    contents: List[Path] = []
+    has_release_pocket = False
+    for path in sorted(lists_dir.iterdir()):
+        m = LOCAL_CONTENTS_PATTERN.fullmatch(path.name)
+        if (
+            not m
+            or m["arch"] not in (arch, "all")
+            or m["suite"].split("-")[0] != os_version
+        ):
+            continue
+        elif m["compression"] == "lz4" and shutil.which("lz4") is None:
+            logger.warning(f"Skipping {path!s} because the `lz4` command is missing")
+            continue
+        contents.append(path)
+        has_release_pocket = has_release_pocket or m["suite"] == os_version
+    if not has_release_pocket:
+        return []
+    return contents
+
+
+@contextmanager
+def open_contents(path: Path) -> Iterator[BinaryIO]:
+    """Opens a possibly compressed Contents index from an apt lists directory"""
+    if path.suffix == ".gz":
+        with gzip.open(path, "rb") as gz:
+            yield gz  # type: ignore
+    elif path.suffix == ".xz":
+        with lzma.open(path, "rb") as xz:
+            yield xz  # type: ignore
+    elif path.suffix == ".lz4":
+        # apt-file stores its indexes lz4-compressed, for which Python has no built-in module
+        with subprocess.Popen(
+            ["lz4", "-dc", str(path)], stdout=subprocess.PIPE
+        ) as proc:
+            assert proc.stdout is not None
+            yield proc.stdout  # type: ignore
+            proc.stdout.read()
+        if proc.returncode != 0:
+            raise AptResolutionError(
+                f"`lz4` exited with code {proc.returncode} while decompressing {path!s}"
+            )
+    else:
+        with open(path, "rb") as f:
+            yield f
+
+
 class Apt(PackageManager):
     NAME = "apt"
 
     def update(self, container: DockerContainer) -> Tuple[int, bytes]:
         return container.exec_run("apt-get update -y")
 
-    def install(self, container: DockerContainer, *packages: str) -> Tuple[int, bytes]:
+    def install_command(self, packages: Iterable[str]) -> str:
+        return f"apt-get -y install {' '.join(packages)}"
+
+    def installed_packages(
+        self, container: DockerContainer
+    ) -> Optional[FrozenSet[str]]:
+        retval, output = container.exec_run(
+            "dpkg-query -W -f '${db:Status-Status} ${binary:Package}\\n'"
+        )
+        if retval != 0:
+            return None
+        installed: Set[str] = set()
+        for line in output.decode("utf-8").splitlines():
+            status, _, package = line.strip().partition(" ")
+            if status == "installed":
+                installed.add(package)
+        return frozenset(installed)
+
+    def package_files(
+        self, container: DockerContainer, packages: Iterable[str]
+    ) -> Optional[FrozenSet[str]]:
+        packages = tuple(packages)
         if not packages:
-            return 0, b""
-        return container.exec_run(f"apt-get -y install {' '.join(packages)}")
+            return frozenset()
+        retval, output = container.exec_run(f"dpkg -L {' '.join(packages)}")
+        if retval != 0:
+            return None
+        # skip lines such as "diverted by ... to: ..." that are not paths
+        return frozenset(
+            line for line in output.decode("utf-8").splitlines() if line.startswith("/")
+        )
 
     @classmethod
     def versions(cls: Type[T]) -> Iterator[T]:
         """Yields all possible configurations"""
-        contents_url = "http://security.ubuntu.com/ubuntu/dists/"
+        contents_url = f"{apt_mirror()}/dists/"
         request = urlopen(contents_url)
         data = request.read()
         parser = UbuntuDistParser()
@@ -90,32 +270,90 @@ class Apt(PackageManager):
                     )
                 )
 
-    def iter_packages(self) -> Iterator[Tuple[str, FrozenSet[str]]]:
+    def release_checksum(self, path: str) -> Optional[str]:
+        """Returns the SHA256 digest of `path` listed in this release's Release file"""
+        release_url = f"{apt_mirror()}/dists/{self.config.os_version}/Release"
+        try:
+            with urlopen(release_url, timeout=60) as response:
+                release = response.read().decode("utf-8")
+        except (URLError, OSError) as e:
+            logger.warning(
+                f"Unable to download {release_url} ({e!s}); the package database will "
+                "not be verified"
+            )
+            return None
+        checksum = parse_release_checksum(release, path)
+        if checksum is None:
+            logger.warning(
+                f"{release_url} does not list a SHA256 digest for {path}; the package "
+                "database will not be verified"
+            )
+        return checksum
+
+    def sources_id(self) -> Optional[str]:
+        sources = apt_sources()
+        if apt_mirror() == DEFAULT_MIRROR and sources is None:
+            return None
+        return sources_digest(apt_mirror(), sources or "")
+
+    def local_contents(self) -> List[Path]:
+        """Returns this release's Contents indexes that apt-file already fetched on this host"""
+        lists_dir = apt_lists_dir()
+        local = PackagingConfig.get_local()
+        if lists_dir is None or local is None:
+            return []
+        elif os.environ.get(MIRROR_ENV) or apt_sources() is not None:
+            # the host's lists describe its own sources, not the configured ones
+            return []
+        local_arch = DPKG_ARCHITECTURES.get(local.arch, local.arch)
+        if (local.os, local.os_version, local_arch) != (
+            self.config.os,
+            self.config.os_version,
+            self.config.arch,
+        ):
+            return []
+        return local_contents_files(lists_dir, self.config.os_version, self.config.arch)
+
+    def iter_packages(
+        self, progress: Optional[Progress] = None
+    ) -> Iterator[Tuple[str, FrozenSet[str]]]:
         """
         Downloads the APT file database and presents it as an iterator.
+
+        If this host runs the same release and apt-file has fetched its Contents indexes,
+        those are read instead, without using the network.
         """
+        # for some reason, Ubuntu doesn't include /usr/bin/cc in its package database:
+        yield "usr/bin/cc", frozenset({"gcc", "g++", "clang"})
+        local_contents = self.local_contents()
+        if local_contents:
+            for path in local_contents:
+                logger.info(f"Reading the local package index {path!s}")
+                with open_contents(path) as stream:
+                    yield from iter_contents(stream)
+            return
         contents_url = (
-            "http://security.ubuntu.com/ubuntu/dists/"
+            f"{apt_mirror()}/dists/"
             f"{self.config.os_version}/Contents-{self.config.arch}.gz"
         )
         logger.info(
             f"Downloading {contents_url}\n"
             "This is a one-time download and may take a few minutes."
         )
-        # for some reason, Ubuntu doesn't include /usr/bin/cc in its package database:
-        yield "usr/bin/cc", frozenset({"gcc", "g++", "clang"})
-        contents_pattern = re.compile(r"(\S+)\s+(\S.*)")
+        config_name = self.with_sources_id(
+            f"{self.NAME}_{self.config.os}_{self.config.os_version}"
+        )
         try:
-            with DownloadWithProgress(contents_url) as p, gzip.open(p, "rb") as gz:
-                for line in iterative_readlines(gz):  # type: ignore
-                    m = contents_pattern.match(line.decode("utf-8"))
-                    if not m:
-                        raise ValueError(f"Unexpected line: {line!r}")
-                    filename = m.group(1)
-                    packages = frozenset(
-                        pkg.split("/")[-1].strip() for pkg in m.group(2).split(",")
-                    )
-                    yield filename, packages
+            download = DownloadWithProgress(
+                contents_url,
+                progress=progress,
+                filename=f"{self.config.os_version}/Contents-{self.config.arch}.gz",
+                destination=DOWNLOAD_DIR
+                / f"{config_name}_Contents-{self.config.arch}.gz",
+                sha256=self.release_checksum(f"Contents-{self.config.arch}.gz"),
+            )
+            with download as p, gzip.open(p, "rb") as gz:
+                yield from iter_contents(gz)  # type: ignore
             error = None
         except HTTPError as e:
             error = e
@@ -135,6 +373,19 @@ class Apt(PackageManager):
                 )
 
     def dockerfile(self) -> str:
+        sources = apt_sources()
+        if sources is None:
+            replace_sources = ""
+        else:
+            entries = " && ".join(
+                f"echo {shlex.quote(line.strip())} >> /etc/apt/sources.list.d/deptective.list"
+                for line in sources.splitlines()
+                if line.strip()
+            )
+            replace_sources = (
+                "RUN rm -f /etc/apt/sources.list /etc/apt/sources.list.d/* && "
+                f"{entries}\n"
+            )
         return f"""FROM {self.config.os}:{self.config.os_version} AS builder
         
 ENV DEBIAN_FRONTEND=noninteractive
@@ -142,7 +393,7 @@ RUN apt-get -y update && apt-get install -y strace
 
 FROM {self.config.os}:{self.config.os_version}
 ENV DEBIAN_FRONTEND=noninteractive
-RUN apt-get -y update
+{replace_sources}RUN apt-get -y update
 RUN echo "APT::Get::Install-Recommends \"false\";" >> /etc/apt/apt.conf
 RUN echo "APT::Get::Install-Suggests \"false\";" >> /etc/apt/apt.conf
 RUN mkdir /src/
@@ -0,0 +1,114 @@
+import math
+import os
+import struct
+from hashlib import blake2b
+from pathlib import Path
+from typing import Iterable, Iterator, Optional
+
+# the default fraction of unpackaged paths that the filter fails to reject
+DEFAULT_FALSE_POSITIVE_RATE = 0.01
+
+
+class BloomFilter:
+    """
+    A Bloom filter of strings, used to reject most paths that no package provides before
+    querying a package cache.
+
+    It is serialized as a small header followed by the bit array, so that it can be
+    persisted next to a cache and read by other tools.
+    """
+
+    MAGIC = b"DPTBLOOM"
+    VERSION = 1
+    # magic, version, number of hash functions, number of bits, number of items
+    HEADER = struct.Struct("<8sBBQQ")
+
+    def __init__(
+        self, num_bits: int, num_hashes: int, bits: Optional[bytearray] = None
+    ):
+        if num_bits <= 0 or num_hashes <= 0:
+            raise ValueError("A Bloom filter needs at least one bit and one hash")
+        self.num_bits: int = num_bits
+        self.num_hashes: int = num_hashes
+        if bits is None:
+            bits = bytearray((num_bits + 7) // 8)
+        elif len(bits) != (num_bits + 7) // 8:
+            raise ValueError(
+                f"Expected {(num_bits + 7) // 8} bytes of bits but got {len(bits)}"
+            )
+        self.bits: bytearray = bits
+        self.items: int = 0
+
+    @classmethod
+    def for_capacity(
+        cls,
+        capacity: int,
+        false_positive_rate: float = DEFAULT_FALSE_POSITIVE_RATE,
+    ) -> "BloomFilter":
+        """Returns an empty filter sized to hold `capacity` items at the given rate"""
+        capacity = max(1, capacity)
+        num_bits = math.ceil(
+            -capacity * math.log(false_positive_rate) / math.log(2) ** 2
+        )
+        num_hashes = max(1, round(num_bits / capacity * math.log(2)))
+        return cls(num_bits=num_bits, num_hashes=num_hashes)
+
+    @classmethod
+    def from_items(
+        cls,
+        items: Iterable[str],
+        capacity: int,
+        false_positive_rate: float = DEFAULT_FALSE_POSITIVE_RATE,
+    ) -> "BloomFilter":
+        ret = cls.for_capacity(capacity, false_positive_rate)
+        for item in items:
+            ret.add(item)
+        return ret
+
+    def _positions(self, item: str) -> Iterator[int]:
+        # Kirsch-Mitzenmacher double hashing derives every position from a single digest
+        digest = blake2b(item.encode("utf-8"), digest_size=16).digest()
+        h1 = int.from_bytes(digest[:8], "little")
+        h2 = int.from_bytes(digest[8:], "little") | 1
+        for i in range(self.num_hashes):
+            yield (h1 + i * h2) % self.num_bits
+
+    def add(self, item: str):
+        for position in self._positions(item):
+            self.bits[position >> 3] |= 1 << (position & 7)
+        self.items += 1
+
+    def __contains__(self, item: str) -> bool:
+        return all(
+            self.bits[position >> 3] & (1 << (position & 7))
+            for position in self._positions(item)
+        )
+
+    def __len__(self) -> int:
+        return self.items
+
+    def to_bytes(self) -> bytes:
+        header = self.HEADER.pack(
+            self.MAGIC, self.VERSION, self.num_hashes, self.num_bits, self.items
+        )
+        return header + bytes(self.bits)
+
+    @classmethod
+    def from_bytes(cls, data: bytes) -> "BloomFilter":
+        if len(data) < cls.HEADER.size:
+            raise ValueError("Truncated Bloom filter")
+        magic, version, num_hashes, num_bits, items = cls.HEADER.unpack_from(data)
+        if magic != cls.MAGIC or version != cls.VERSION:
+            raise ValueError("Not a Bloom filter, or an unsupported version of one")
+        ret = cls(num_bits, num_hashes, bytearray(data[cls.HEADER.size :]))
+        ret.items = items
+        return ret
+
+    def save(self, path: Path):
+        tmp_path = path.with_name(f".{path.name}.{os.getpid()}.tmp")
+        tmp_path.write_bytes(self.to_bytes())
+        tmp_path.replace(path)
+
+    @classmethod
+    def load(cls, path: Path) -> "BloomFilter":
+        return cls.from_bytes(path.read_bytes())
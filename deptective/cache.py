@@ -1,12 +1,46 @@
+import hashlib
+import logging
+import os
 import sqlite3
+import threading
 from abc import ABC, abstractmethod
+from concurrent.futures import Future, ThreadPoolExecutor, as_completed
+from contextlib import closing
+from inspect import isabstract
 from pathlib import Path
-from typing import FrozenSet, Iterable, Iterator, Set, Tuple, Type, TypeVar, Union
+from tempfile import TemporaryDirectory
+from typing import (
+    Callable,
+    Dict,
+    FrozenSet,
+    Iterable,
+    Iterator,
+    Optional,
+    Set,
+    Tuple,
+    Type,
+    TypeVar,
+    Union,
+)
 
 from appdirs import AppDirs
+from rich.console import Console
+from rich.progress import (
+    BarColumn,
+    DownloadColumn,
+    Progress,
+    TextColumn,
+    TimeRemainingColumn,
+    TransferSpeedColumn,
+)
 
+from .bloom import BloomFilter
+from .logs import file_sha256
+from .metrics import CACHE_FILTERED, CACHE_HITS, CACHE_LOOKUPS
 from .package_manager import PackageManager
 
+logger = logging.getLogger(__name__)
+
 APP_DIRS = AppDirs("deptective", "Trail of Bits")
 CACHE_DIR = Path(APP_DIRS.user_cache_dir)
 if not CACHE_DIR.exists():
@@ -14,10 +48,95 @@ if not CACHE_DIR.exists():
 
 T = TypeVar("T")
 
+# maps the NAME of every concrete on-disk cache implementation to its class
+CACHE_BACKENDS: Dict[str, Type["Cache"]] = {}
+
+# the maximum number of filenames looked up in a single batched query
+BATCH_SIZE = 500
+
+
+def normalize_path(filename: Union[str, bytes, Path]) -> str:
+    if isinstance(filename, Path):
+        filename = str(filename)
+    elif isinstance(filename, bytes):
+        filename = filename.decode("utf-8")
+    if filename.startswith("/"):
+        # the contents paths do not start with a leading slash
+        filename = filename[1:]
+    return filename
+
+
+def bloom_path(db_path: Path) -> Path:
+    return db_path.with_suffix(".bloom")
+
+
+def load_bloom_filter(
+    db_path: Path,
+    packaged_paths: Callable[[], Tuple[int, Iterable[str]]],
+    rebuild: bool = False,
+) -> BloomFilter:
+    """
+    Loads the Bloom filter persisted next to the database at `db_path`, building it from
+    `packaged_paths` (which returns the number of paths and an iterable over them) and
+    saving it if it is missing, unreadable, older than the database, or `rebuild` is set.
+    """
+    path = bloom_path(db_path)
+    if not rebuild:
+        try:
+            if path.stat().st_mtime_ns >= db_path.stat().st_mtime_ns:
+                return BloomFilter.load(path)
+        except (OSError, ValueError):
+            pass
+    count, paths = packaged_paths()
+    bloom_filter = BloomFilter.from_items(paths, capacity=count)
+    try:
+        bloom_filter.save(path)
+    except OSError as e:
+        logger.warning(f"Unable to save the Bloom filter {path!s}: {e!s}")
+    return bloom_filter
+
 
 class Cache(ABC):
+    NAME: str
+
     def __init__(self, package_manager: PackageManager):
         self.package_manager: PackageManager = package_manager
+        self._bloom_filter: Optional[BloomFilter] = None
+        self._bloom_filter_loader: Optional[Callable[[], BloomFilter]] = None
+        self._bloom_filter_lock = threading.Lock()
+
+    @property
+    def bloom_filter(self) -> Optional[BloomFilter]:
+        """If set, paths that it rejects are known not to be provided by any package"""
+        if self._bloom_filter_loader is not None:
+            with self._bloom_filter_lock:
+                if self._bloom_filter_loader is not None:
+                    self._bloom_filter = self._bloom_filter_loader()
+                    self._bloom_filter_loader = None
+        return self._bloom_filter
+
+    @bloom_filter.setter
+    def bloom_filter(self, bloom_filter: Optional[BloomFilter]):
+        with self._bloom_filter_lock:
+            self._bloom_filter = bloom_filter
+            self._bloom_filter_loader = None
+
+    def load_bloom_filter_lazily(self, db_path: Path):
+        """Loads (or builds) the filter next to `db_path` on the first lookup, so that
+        opening a database, e.g., only to delete it, never hashes all of its paths"""
+        with self._bloom_filter_lock:
+            self._bloom_filter_loader = lambda: load_bloom_filter(
+                db_path, self._packaged_paths
+            )
+
+    def _packaged_paths(self) -> Tuple[int, Iterable[str]]:
+        """The number of distinct paths in the cache and an iterable over them"""
+        raise NotImplementedError()
+
+    def __init_subclass__(cls, **kwargs):
+        super().__init_subclass__(**kwargs)
+        if getattr(cls, "NAME", None) and not isabstract(cls):
+            CACHE_BACKENDS[cls.NAME] = cls
 
     def __contains__(self, filename: Union[str, bytes, Path]):
         return bool(self[filename])
@@ -27,15 +146,23 @@ class Cache(ABC):
         raise NotImplementedError()
 
     def __getitem__(self, filename: Union[str, bytes, Path]) -> FrozenSet[str]:
-        if isinstance(filename, Path):
-            filename = str(filename)
-        elif isinstance(filename, bytes):
-            filename = filename.decode("utf-8")
-        if filename.startswith("/"):
-            filename = filename[
-                1:
-            ]  # the contents paths do not start with a leading slash
-        return self.packages_providing(filename)
+        return self.lookup_many((filename,))[normalize_path(filename)]
+
+    def lookup_many(
+        self, filenames: Iterable[Union[str, bytes, Path]]
+    ) -> Dict[str, FrozenSet[str]]:
+        """Looks up several paths at once, returning a mapping from each normalized path
+        (without a leading slash) to the packages providing it"""
+        normalized = {normalize_path(f) for f in filenames}
+        bloom_filter = self.bloom_filter
+        if bloom_filter is None:
+            return self.packages_providing_many(normalized)
+        candidates = {f for f in normalized if f in bloom_filter}
+        rejected = len(normalized) - len(candidates)
+        CACHE_LOOKUPS.inc(rejected)
+        CACHE_FILTERED.inc(rejected)
+        found = self.packages_providing_many(candidates) if candidates else {}
+        return {f: found.get(f, frozenset()) for f in normalized}
 
     def __enter__(self: T) -> T:
         return self
@@ -57,6 +184,15 @@ class Cache(ABC):
         """
         raise NotImplementedError()
 
+    def packages_providing_many(
+        self, filenames: Iterable[str]
+    ) -> Dict[str, FrozenSet[str]]:
+        """Returns the packages providing each of `filenames`, none of which will
+        contain a leading '/' slash. Backends can override this to batch their lookups.
+
+        """
+        return {filename: self.packages_providing(filename) for filename in filenames}
+
     @abstractmethod
     def save(self):
         raise NotImplementedError()
@@ -74,26 +210,103 @@ class Cache(ABC):
     ) -> T:
         """
         Imports the iterable `packages` into the native cache format, returning a new
-        cache object.
+        cache object. Any existing cache for `package_manager` is only replaced once the
+        import completes, so it survives a failed download.
         """
         raise NotImplementedError()
 
+    @classmethod
+    def rebuild(
+        cls: Type[T],
+        package_manager: PackageManager,
+        progress: Optional[Progress] = None,
+    ) -> T:
+        """
+        Rebuilds the cache for `package_manager` from the package manager's database,
+        reporting download progress to `progress`. Any existing cache is replaced once
+        the new one is complete.
+        """
+        return cls.from_iterable(  # type: ignore
+            package_manager, package_manager.iter_packages(progress=progress)
+        )
+
     @abstractmethod
     def delete(self):
         raise NotImplementedError()
 
+    def fingerprint(self) -> Optional[str]:
+        """A digest of the package database's contents, or None if it is unknown"""
+        return None
+
+    def close(self):
+        pass
+
+
+def rebuild_caches(
+    package_managers: Iterable[PackageManager],
+    cache_class: Type[Cache],
+    jobs: int = 4,
+    console: Optional[Console] = None,
+) -> Dict[PackageManager, Optional[Exception]]:
+    """
+    Rebuilds the caches for all of `package_managers` concurrently, using at most `jobs`
+    simultaneous download/ingest workers. Returns a mapping from each package manager
+    to the exception that caused its rebuild to fail, or None if it succeeded.
+    """
+    package_managers = list(package_managers)
+    errors: Dict[PackageManager, Optional[Exception]] = {}
+    if not package_managers:
+        return errors
+    progress = Progress(
+        TextColumn("[bold blue]{task.fields[filename]}", justify="right"),
+        BarColumn(bar_width=None),
+        "[progress.percentage]{task.percentage:>3.1f}%",
+        "•",
+        DownloadColumn(),
+        "•",
+        TransferSpeedColumn(),
+        "•",
+        TimeRemainingColumn(),
+        console=console,
+    )
+
+    def rebuild(package_manager: PackageManager):
+        cache = cache_class.rebuild(package_manager, progress=progress)
+        cache.close()
+
+    with progress, ThreadPoolExecutor(
+        max_workers=max(1, jobs), thread_name_prefix="deptective-rebuild"
+    ) as pool:
+        futures: Dict[Future, PackageManager] = {
+            pool.submit(rebuild, pm): pm for pm in package_managers
+        }
+        for future in as_completed(futures):
+            pm = futures[future]
+            name = f"{pm.NAME} ({pm.config.os}:{pm.config.os_version}-{pm.config.arch})"
+            try:
+                future.result()
+                errors[pm] = None
+                progress.console.log(f"Rebuilt the package cache for {name}")
+            except Exception as e:
+                errors[pm] = e
+                progress.console.log(f"Failed to rebuild the package cache for {name}")
+    return errors
+
 
 class SQLCache(Cache, ABC):
+    NAME = "sqlite"
+
     def __init__(self, package_manager: PackageManager, conn: sqlite3.Connection):
         super().__init__(package_manager)
         self.conn: sqlite3.Connection = conn
 
     @classmethod
     def path(cls, package_manager: PackageManager) -> Path:
-        return CACHE_DIR / (
+        name = package_manager.with_sources_id(
             f"{package_manager.NAME}_{package_manager.config.os}_{package_manager.config.os_version}_"
-            f"{package_manager.config.arch}.sqlite3"
+            f"{package_manager.config.arch}"
         )
+        return CACHE_DIR / f"{name}.sqlite3"
 
     def __iter__(self) -> Iterator[Tuple[str, FrozenSet[str]]]:
         cur = self.conn.cursor()
@@ -119,7 +332,9 @@ class SQLCache(Cache, ABC):
         db_path = cls.path(package_manager)  # type: ignore
         if not db_path.exists():
             return cls.from_iterable(package_manager, package_manager.iter_packages())  # type: ignore
-        return cls(package_manager, conn=sqlite3.connect(str(db_path)))  # type: ignore
+        ret: T = cls(package_manager, conn=sqlite3.connect(str(db_path)))  # type: ignore
+        ret.load_bloom_filter_lazily(db_path)  # type: ignore
+        return ret
 
     @classmethod
     def from_iterable(
@@ -127,22 +342,32 @@ class SQLCache(Cache, ABC):
         package_manager: PackageManager,
         packages: Iterable[Tuple[str, Iterable[str]]],
     ) -> T:
-        ret: T = cls(package_manager, conn=sqlite3.connect(str(cls.path(package_manager))))  # type: ignore
-
+        db_path = cls.path(package_manager)  # type: ignore
+        # import into a temporary file that replaces any existing database once complete
+        tmp_path = db_path.with_name(
+            f".{db_path.name}.{os.getpid()}.{threading.get_ident()}.tmp"
+        )
+        conn = sqlite3.connect(str(tmp_path))
         try:
-            ret._create_tables()  # type: ignore
-            with ret.conn:  # type: ignore
+            staging: T = cls(package_manager, conn=conn)  # type: ignore
+            staging._create_tables()  # type: ignore
+            with conn:
                 for filename, pkgs in packages:
-                    ret.conn.executemany(  # type: ignore
-                        "INSERT INTO files(filename, package) VALUES(?, ?)",
+                    conn.executemany(
+                        "INSERT OR IGNORE INTO files(filename, package) VALUES(?, ?)",
                         [(filename, package) for package in pkgs],
                     )
-            return ret
+            conn.close()
+            tmp_path.replace(db_path)
         except:
-            contents_db_path = ret.path(package_manager)  # type: ignore
-            if contents_db_path.exists():
-                contents_db_path.unlink()
+            conn.close()
+            tmp_path.unlink(missing_ok=True)
             raise
+        ret: T = cls(package_manager, conn=sqlite3.connect(str(db_path)))  # type: ignore
+        ret.bloom_filter = load_bloom_filter(  # type: ignore
+            db_path, ret._packaged_paths, rebuild=True  # type: ignore
+        )
+        return ret
 
     @classmethod
     def exists(cls, package_manager: PackageManager) -> bool:
@@ -151,7 +376,30 @@ class SQLCache(Cache, ABC):
     def packages_providing(self, filename: str) -> FrozenSet[str]:
         cur = self.conn.cursor()
         res = cur.execute("SELECT package FROM files WHERE filename = ?", (filename,))
-        return frozenset(c[0] for c in res.fetchall())
+        packages = frozenset(c[0] for c in res.fetchall())
+        CACHE_LOOKUPS.inc()
+        if packages:
+            CACHE_HITS.inc()
+        return packages
+
+    def packages_providing_many(
+        self, filenames: Iterable[str]
+    ) -> Dict[str, FrozenSet[str]]:
+        filenames = list(filenames)
+        found: Dict[str, Set[str]] = {filename: set() for filename in filenames}
+        cur = self.conn.cursor()
+        for i in range(0, len(filenames), BATCH_SIZE):
+            batch = filenames[i : i + BATCH_SIZE]
+            res = cur.execute(
+                "SELECT filename, package FROM files WHERE filename IN "
+                f"({', '.join('?' * len(batch))})",
+                batch,
+            )
+            for filename, package in res.fetchall():
+                found[filename].add(package)
+        CACHE_LOOKUPS.inc(len(found))
+        CACHE_HITS.inc(sum(1 for packages in found.values() if packages))
+        return {filename: frozenset(packages) for filename, packages in found.items()}
 
     def _create_tables(self):
         assert self.conn is not None
@@ -162,7 +410,8 @@ class SQLCache(Cache, ABC):
             package TEXT NOT NULL
         )"""
         )
-        cur.execute("CREATE INDEX filenames ON files(filename)")
+        # several pockets or mirrors may list the same file in the same package
+        cur.execute("CREATE UNIQUE INDEX filenames ON files(filename, package)")
         cur.execute("CREATE INDEX packages ON files(package)")
         self.conn.commit()
 
@@ -172,5 +421,310 @@ class SQLCache(Cache, ABC):
             self.conn.commit()
         assert contents_db_path.exists()
 
+    def _packaged_paths(self) -> Tuple[int, Iterable[str]]:
+        count = self.conn.execute(
+            "SELECT COUNT(DISTINCT filename) FROM files"
+        ).fetchone()[0]
+        return count, (
+            row[0] for row in self.conn.execute("SELECT DISTINCT filename FROM files")
+        )
+
+    def fingerprint(self) -> Optional[str]:
+        self.conn.commit()
+        return file_sha256(self.path(self.package_manager))
+
     def delete(self):
         self.path(self.package_manager).unlink()
+        bloom_path(self.path(self.package_manager)).unlink(missing_ok=True)
+
+    def close(self):
+        self.conn.close()
+
+
+class CacheCapacityError(RuntimeError):
+    pass
+
+
+class SharedSQLCache(Cache):
+    """
+    Stores the package databases of every configuration of a package manager in a single
+    SQLite file.
+
+    Each path and package name is stored once, and every (path, package) row carries a
+    bitmask of the configurations whose database contains it, so adding a release only
+    adds the rows that differ from the releases that are already cached.
+    """
+
+    NAME = "shared-sqlite"
+    # configuration bits must fit in a positive signed 64-bit SQLite integer
+    MAX_CONFIGS = 63
+
+    # serializes ingests into the same file from concurrent rebuilds
+    _write_lock = threading.Lock()
+
+    def __init__(self, package_manager: PackageManager, conn: sqlite3.Connection):
+        super().__init__(package_manager)
+        self.conn: sqlite3.Connection = conn
+        self._create_tables()
+        config_id = self._config_id()
+        self.mask: int = 0 if config_id is None else 1 << config_id
+
+    @classmethod
+    def path(cls, package_manager: PackageManager) -> Path:
+        name = package_manager.with_sources_id(f"{package_manager.NAME}_shared")
+        return CACHE_DIR / f"{name}.sqlite3"
+
+    @classmethod
+    def connect(cls, package_manager: PackageManager) -> sqlite3.Connection:
+        # another process may be merging a release into the same file
+        conn = sqlite3.connect(str(cls.path(package_manager)), timeout=600)
+        # let lookups proceed while another configuration is being merged
+        conn.execute("PRAGMA journal_mode=WAL")
+        return conn
+
+    def _config_key(self) -> Tuple[str, str, str]:
+        config = self.package_manager.config
+        return config.os, config.os_version, config.arch
+
+    def _config_id(self, complete_only: bool = True) -> Optional[int]:
+        row = self.conn.execute(
+            "SELECT id, complete FROM configs WHERE os = ? AND os_version = ? AND arch = ?",
+            self._config_key(),
+        ).fetchone()
+        if row is None or (complete_only and not row[1]):
+            return None
+        return row[0]
+
+    def _create_tables(self):
+        with self.conn:
+            self.conn.executescript(
+                """
+                CREATE TABLE IF NOT EXISTS configs(
+                    id INTEGER PRIMARY KEY,
+                    os TEXT NOT NULL,
+                    os_version TEXT NOT NULL,
+                    arch TEXT NOT NULL,
+                    complete INTEGER NOT NULL DEFAULT 0,
+                    UNIQUE(os, os_version, arch)
+                );
+                CREATE TABLE IF NOT EXISTS paths(
+                    id INTEGER PRIMARY KEY,
+                    path TEXT NOT NULL UNIQUE
+                );
+                CREATE TABLE IF NOT EXISTS packages(
+                    id INTEGER PRIMARY KEY,
+                    name TEXT NOT NULL UNIQUE
+                );
+                CREATE TABLE IF NOT EXISTS files(
+                    path_id INTEGER NOT NULL REFERENCES paths(id),
+                    package_id INTEGER NOT NULL REFERENCES packages(id),
+                    configs INTEGER NOT NULL,
+                    PRIMARY KEY(path_id, package_id)
+                ) WITHOUT ROWID;
+                """
+            )
+
+    @classmethod
+    def exists(cls, package_manager: PackageManager) -> bool:
+        if not cls.path(package_manager).exists():
+            return False
+        cache = cls(package_manager, conn=cls.connect(package_manager))
+        try:
+            return cache.mask != 0
+        finally:
+            cache.close()
+
+    @classmethod
+    def from_disk(cls: Type[T], package_manager: PackageManager) -> T:
+        cache = cls(package_manager, conn=cls.connect(package_manager))  # type: ignore
+        if cache.mask == 0:  # type: ignore
+            cache.close()  # type: ignore
+            return cls.from_iterable(package_manager, package_manager.iter_packages())  # type: ignore
+        cache.load_bloom_filter_lazily(cls.path(package_manager))  # type: ignore
+        return cache
+
+    @classmethod
+    def from_iterable(
+        cls: Type[T],
+        package_manager: PackageManager,
+        packages: Iterable[Tuple[str, Iterable[str]]],
+    ) -> T:
+        ret: T = cls(package_manager, conn=cls.connect(package_manager))  # type: ignore
+        try:
+            ret._ingest(packages)  # type: ignore
+        except:
+            ret.close()  # type: ignore
+            raise
+        return ret
+
+    def _allocate_config(self) -> int:
+        config_id = self._config_id(complete_only=False)
+        if config_id is not None:
+            return config_id
+        used = {row[0] for row in self.conn.execute("SELECT id FROM configs")}
+        free = [i for i in range(self.MAX_CONFIGS) if i not in used]
+        if not free:
+            raise CacheCapacityError(
+                f"{self.path(self.package_manager)!s} already holds the maximum of "
+                f"{self.MAX_CONFIGS} configurations; delete one before adding "
+                f"{':'.join(self._config_key())}"
+            )
+        self.conn.execute(
+            "INSERT INTO configs(id, os, os_version, arch) VALUES(?, ?, ?, ?)",
+            (free[0], *self._config_key()),
+        )
+        return free[0]
+
+    def _ingest(self, packages: Iterable[Tuple[str, Iterable[str]]]):
+        # stage the rows in a scratch database first, so that concurrent rebuilds only
+        # contend for the shared file while merging rather than while downloading
+        with TemporaryDirectory(dir=CACHE_DIR) as tmpdir:
+            staging = Path(tmpdir) / "staging.sqlite3"
+            with closing(sqlite3.connect(str(staging))) as conn, conn:
+                conn.execute(
+                    "CREATE TABLE files(filename TEXT NOT NULL, package TEXT NOT NULL)"
+                )
+                for filename, pkgs in packages:
+                    conn.executemany(
+                        "INSERT INTO files(filename, package) VALUES(?, ?)",
+                        [(filename, package) for package in pkgs],
+                    )
+            with self._write_lock:
+                self.conn.execute("ATTACH DATABASE ? AS staging", (str(staging),))
+                try:
+                    self._merge()
+                finally:
+                    self.conn.execute("DETACH DATABASE staging")
+                # move the merge into the main file first, so that the filter is newer
+                self.conn.execute("PRAGMA wal_checkpoint(TRUNCATE)")
+                # the filter covers the paths of every configuration in the file
+                self.bloom_filter = load_bloom_filter(
+                    self.path(self.package_manager), self._packaged_paths, rebuild=True
+                )
+
+    def _packaged_paths(self) -> Tuple[int, Iterable[str]]:
+        count = self.conn.execute("SELECT COUNT(*) FROM paths").fetchone()[0]
+        return count, (row[0] for row in self.conn.execute("SELECT path FROM paths"))
+
+    def _merge(self):
+        """Replaces this configuration's rows with those of the attached staging database"""
+        # a single transaction, so a failed merge leaves the other configurations intact
+        with self.conn:
+            config_id = self._allocate_config()
+            mask = 1 << config_id
+            self._clear(mask)
+            # `WHERE true` disambiguates the upsert clause from a join constraint
+            self.conn.execute(
+                "INSERT INTO paths(path) SELECT DISTINCT filename FROM staging.files "
+                "WHERE true ON CONFLICT DO NOTHING"
+            )
+            self.conn.execute(
+                "INSERT INTO packages(name) SELECT DISTINCT package FROM staging.files "
+                "WHERE true ON CONFLICT DO NOTHING"
+            )
+            self.conn.execute(
+                "INSERT INTO files(path_id, package_id, configs) "
+                "SELECT paths.id, packages.id, ? FROM staging.files "
+                "JOIN paths ON paths.path = staging.files.filename "
+                "JOIN packages ON packages.name = staging.files.package "
+                "WHERE true "
+                "ON CONFLICT DO UPDATE SET configs = configs | excluded.configs",
+                (mask,),
+            )
+            self.conn.execute(
+                "UPDATE configs SET complete = 1 WHERE id = ?", (config_id,)
+            )
+        self.mask = mask
+
+    def _clear(self, mask: int):
+        """Removes the configuration with bit `mask` from every row"""
+        self.conn.execute(
+            "UPDATE files SET configs = configs & ? WHERE configs & ? != 0",
+            (~mask, mask),
+        )
+        self.conn.execute("DELETE FROM files WHERE configs = 0")
+
+    def __iter__(self) -> Iterator[Tuple[str, FrozenSet[str]]]:
+        res = self.conn.execute(
+            "SELECT paths.path, packages.name FROM files "
+            "JOIN paths ON paths.id = files.path_id "
+            "JOIN packages ON packages.id = files.package_id "
+            "WHERE files.configs & ? != 0 ORDER BY paths.path",
+            (self.mask,),
+        )
+        filename: Optional[str] = None
+        packages: Set[str] = set()
+        while results := res.fetchmany(1024):
+            for f, package in results:
+                if filename is not None and f != filename:
+                    yield filename, frozenset(packages)
+                    packages = set()
+                filename = f
+                packages.add(package)
+        if filename is not None:
+            yield filename, frozenset(packages)
+
+    def packages_providing(self, filename: str) -> FrozenSet[str]:
+        return self.packages_providing_many((filename,))[filename]
+
+    def packages_providing_many(
+        self, filenames: Iterable[str]
+    ) -> Dict[str, FrozenSet[str]]:
+        filenames = list(filenames)
+        found: Dict[str, Set[str]] = {filename: set() for filename in filenames}
+        for i in range(0, len(filenames), BATCH_SIZE):
+            batch = filenames[i : i + BATCH_SIZE]
+            res = self.conn.execute(
+                "SELECT paths.path, packages.name FROM paths "
+                "JOIN files ON files.path_id = paths.id "
+                "JOIN packages ON packages.id = files.package_id "
+                f"WHERE paths.path IN ({', '.join('?' * len(batch))}) "
+                "AND files.configs & ? != 0",
+                (*batch, self.mask),
+            )
+            for filename, package in res.fetchall():
+                found[filename].add(package)
+        CACHE_LOOKUPS.inc(len(found))
+        CACHE_HITS.inc(sum(1 for packages in found.values() if packages))
+        return {filename: frozenset(packages) for filename, packages in found.items()}
+
+    def save(self):
+        self.conn.commit()
+
+    def fingerprint(self) -> Optional[str]:
+        # the file also holds other configurations, so digest only this one's rows
+        h = hashlib.sha256()
+        res = self.conn.execute(
+            "SELECT paths.path, packages.name FROM files "
+            "JOIN paths ON paths.id = files.path_id "
+            "JOIN packages ON packages.id = files.package_id "
+            "WHERE files.configs & ? != 0 ORDER BY paths.path, packages.name",
+            (self.mask,),
+        )
+        while rows := res.fetchmany(4096):
+            for path, package in rows:
+                h.update(f"{path}\0{package}\n".encode("utf-8"))
+        return h.hexdigest()
+
+    def delete(self):
+        """Removes this configuration, deleting the file once no configuration remains"""
+        with self._write_lock, self.conn:
+            config_id = self._config_id(complete_only=False)
+            if config_id is not None:
+                self._clear(1 << config_id)
+                self.conn.execute("DELETE FROM configs WHERE id = ?", (config_id,))
+                self.conn.execute(
+                    "DELETE FROM paths WHERE id NOT IN (SELECT path_id FROM files)"
+                )
+                self.conn.execute(
+                    "DELETE FROM packages WHERE id NOT IN (SELECT package_id FROM files)"
+                )
+            remaining = self.conn.execute("SELECT COUNT(*) FROM configs").fetchone()[0]
+        self.mask = 0
+        if not remaining:
+            self.conn.close()
+            self.path(self.package_manager).unlink()
+            bloom_path(self.path(self.package_manager)).unlink(missing_ok=True)
+
+    def close(self):
+        self.conn.close()
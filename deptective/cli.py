@@ -1,14 +1,19 @@
 import argparse
+import atexit
+import json
 import logging
 import platform
 import shlex
 import sys
+import time
 from collections import defaultdict
 from shutil import rmtree
 from tempfile import mkdtemp
 from textwrap import dedent
-from typing import List, Optional
+from threading import Lock
+from typing import Any, Callable, Dict, Iterator, List, Optional, TextIO, Type
 
+import docker
 import requests  # type: ignore
 from docker.errors import DockerException
 from pathlib import Path
@@ -18,16 +23,30 @@ from rich.logging import RichHandler
 from rich.panel import Panel
 from rich.table import Table
 
-from . import apt  # noqa: F401
-from .cache import SQLCache
+from . import apk, apt  # noqa: F401
+from .cache import CACHE_BACKENDS, CACHE_DIR, Cache, SQLCache, rebuild_caches
 from .dependencies import (
     SBOM,
+    Decision,
     PackageResolutionError,
     PreinstallError,
+    Resolution,
     SBOMGenerator,
 )
 from .exceptions import PackageDatabaseNotFoundError, SBOMGenerationError
+from .images import export_strace_image, import_strace_images
+from .metrics import METRICS
 from .package_manager import PackageManager, PackagingConfig
+from .profiling import PROFILER
+from .releases import MultiReleaseResolver, release_report
+from .remote import DirectoryStore, RemoteCacheServer, SharedCache, open_store
+from .replay import (
+    RecordingSBOMGenerator,
+    RecordingStore,
+    ReplayCache,
+    ReplaySBOMGenerator,
+)
+from .scheduling import SCHEDULER, HostCapacity
 
 logger = logging.getLogger(__name__)
 logging.getLogger("docker").setLevel(logging.WARNING)
@@ -74,15 +93,251 @@ def load_cache(
     release: str,
     arch: str,
     rebuild: bool = False,
-) -> SQLCache:
+    remote: Optional[SharedCache] = None,
+    cache_class: Type[Cache] = SQLCache,
+) -> Cache:
     mgr_class = PackageManager.MANAGERS_BY_NAME[package_manager_name]
     package_manager = mgr_class(
         PackagingConfig(os=operating_system, os_version=release, arch=arch)
     )
-    if rebuild and SQLCache.exists(package_manager):
-        SQLCache.path(package_manager).unlink()
+    if not issubclass(cache_class, SQLCache):
+        # only the per-configuration databases are exchanged with the remote cache
+        remote = None
+
+    if rebuild:
+        # a database that is rebuilt on request is always built locally, and the old one
+        # is kept until the new one is complete
+        cache = cache_class.rebuild(package_manager)
+        built = True
+    else:
+        built = False
+        if not cache_class.exists(package_manager):
+            built = remote is None or not remote.fetch_database(package_manager)
+        cache = cache_class.from_disk(package_manager)
+    if built and remote is not None:
+        remote.publish_database(package_manager)
+    return cache
+
+
+def serve_cache(root: Path, listen: str) -> int:
+    host, _, port = listen.rpartition(":")
+    try:
+        server = RemoteCacheServer(
+            DirectoryStore(root), host=host or "127.0.0.1", port=int(port)
+        )
+    except (OSError, ValueError) as e:
+        logger.error(f"Unable to serve the cache in {root!s} at {listen}: {e!s}")
+        return 1
+    logger.info(f"Serving the cache in {root!s} at {server.url}")
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+def rebuild_configurations(
+    spec: str,
+    package_manager_name: str,
+    operating_system: str,
+    releases: List[str],
+    arch: str,
+) -> List[PackageManager]:
+    """Returns the package managers whose caches are selected by a `--rebuild-configs`
+    argument, or those of every release in `releases` if `spec` is empty"""
+    mgr_class = PackageManager.MANAGERS_BY_NAME[package_manager_name]
+    if not spec:
+        return [
+            mgr_class(PackagingConfig(os=operating_system, os_version=r, arch=arch))
+            for r in releases
+        ]
+    elif spec == "all":
+        return list(mgr_class.versions())
+    package_managers: List[PackageManager] = []
+    for item in spec.split(","):
+        fields = item.strip().split(":")
+        if len(fields) == 2:
+            config = PackagingConfig(
+                os=operating_system, os_version=fields[0], arch=fields[1]
+            )
+        elif len(fields) == 3:
+            config = PackagingConfig(os=fields[0], os_version=fields[1], arch=fields[2])
+        else:
+            raise ValueError(
+                f"Invalid configuration {item!r}; expected `RELEASE:ARCH` or "
+                "`OS:RELEASE:ARCH`"
+            )
+        package_managers.append(mgr_class(config))
+    return package_managers
+
+
+def load_multi_step_commands(paths: List[str]) -> Optional[List[List[str]]]:
+    commands: List[List[str]] = []
+    for path in paths:
+        try:
+            with open(path, "r") as f:
+                for line in f:
+                    line = line.strip()
+                    if not line or line.startswith("#"):
+                        continue
+                    commands.append(shlex.split(line))
+        except (FileNotFoundError, IOError) as e:
+            logger.error(f"Could not open multi-step file {path}: {e!s}")
+            return None
+    return commands
+
+
+def write_ndjson(stream: TextIO, record: Dict[str, Any]):
+    stream.write(json.dumps(record))
+    stream.write("\n")
+    stream.flush()
+
+
+def read_seed(path: Path) -> List[Decision]:
+    """Reads the decisions of every result in the output of a `--format ndjson` run"""
+    decisions: List[Decision] = []
+    with open(path, "r") as f:
+        for line in f:
+            line = line.strip()
+            if not line:
+                continue
+            record = json.loads(line)
+            decisions.extend(Decision.from_json(d) for d in record.get("decisions", ()))
+    return decisions
+
+
+def ndjson_summary(
+    generator: Optional[SBOMGenerator],
+    results: int,
+    succeeded: bool,
+    start: float,
+    log_dir: Optional[Path] = None,
+) -> Dict[str, Any]:
+    summary: Dict[str, Any] = {
+        "type": "summary",
+        "status": "success" if succeeded else "failure",
+        "results": results,
+        "steps_explored": 0 if generator is None else generator.steps_explored,
+        "images_built": 0 if generator is None else generator.images_built,
+        "wall_time": time.perf_counter() - start,
+    }
+    if log_dir is not None:
+        summary["log_dir"] = str(log_dir)
+    return summary
+
+
+def main_multi_release(
+    args: argparse.Namespace,
+    caches: Dict[str, Cache],
+    console: Console,
+    seed: List[Decision],
+    remote: Optional[SharedCache] = None,
+    generator_class: Callable[..., SBOMGenerator] = SBOMGenerator,
+) -> int:
+    if args.search:
+        success = True
+        for path in args.command:
+            for release, cache in caches.items():
+                pkgs = cache[path]
+                if not pkgs:
+                    logger.info(f"No packages found on {release} that provide {path}")
+                    success = False
+                    continue
+                logger.info(
+                    f"[bold white]Packages providing[/bold white] {path} on {release}: "
+                    f"{'[gray],[/gray] '.join(pkgs)}",
+                    extra={"markup": True},
+                )
+        if success:
+            return 0
+        else:
+            return 1
+
+    if args.multi_step:
+        commands = load_multi_step_commands(args.command)
+        if commands is None:
+            return 1
+    else:
+        commands = [args.command]
+
+    def results_for(generator: SBOMGenerator) -> Iterator[Resolution]:
+        return generator.resolve(*commands)
+
+    # rich has a tendency to gobble stdout, so save the old one before proceeding:
+    old_stdout = sys.stdout
+    stdout_lock = Lock()
+    start = time.perf_counter()
+
+    def on_result(release: str, result: Resolution):
+        with stdout_lock:
+            write_ndjson(
+                old_stdout, {"type": "result", "release": release, **result.to_json()}
+            )
+
+    resolver = MultiReleaseResolver(
+        caches, console=console, generator_class=generator_class
+    )
+    for generator in resolver.generators.values():
+        generator.rerun_failing_subprocess = not args.full_reruns
+        generator.add_seed(seed)
+        if remote is not None:
+            remote.prepare(generator, commands)
+    try:
+        results = resolver.resolve(
+            results_for,
+            num_results=0 if args.all else args.num_results,
+            on_result=on_result if args.format == "ndjson" else None,
+        )
+    except KeyboardInterrupt:
+        console.show_cursor()
+        return 1
 
-    return SQLCache.from_disk(package_manager)
+    if remote is not None:
+        for release, resolution in results.items():
+            remote.publish(resolver.generators[release], commands, resolution.results)
+
+    console.print(release_report(results))
+
+    for release, resolution in results.items():
+        if args.format == "ndjson":
+            write_ndjson(
+                old_stdout,
+                {
+                    "release": release,
+                    **ndjson_summary(
+                        resolver.generators[release],
+                        len(resolution.results),
+                        resolution.succeeded,
+                        start,
+                    ),
+                },
+            )
+            continue
+        for sbom in resolution.sboms:
+            old_stdout.write(f"{release}: {sbom!s}\n")
+    old_stdout.flush()
+
+    if all(resolution.succeeded for resolution in results.values()):
+        return 0
+    return 1
+
+
+def write_profile(path: Path):
+    try:
+        PROFILER.write(path)
+    except OSError as e:
+        logger.error(f"Unable to write the profile to {path!s}: {e!s}")
+        return
+    logger.info(f"Wrote the profile to {path!s}")
+
+
+def write_metrics(path: Path):
+    try:
+        METRICS.write(path)
+    except OSError as e:
+        logger.error(f"Unable to write the metrics to {path!s}: {e!s}")
+        return
+    logger.info(f"Wrote the metrics to {path!s}")
 
 
 def main() -> int:
@@ -120,8 +375,9 @@ def main() -> int:
         "-r",
         type=str,
         default=default_release,
-        help=f"the release of the operating system in which to resolve packages "
-        f"(default={default_release})",
+        help=f"the release of the operating system in which to resolve packages; separate "
+        f"multiple releases with commas (e.g., `focal,jammy,noble`) to resolve against all "
+        f"of them concurrently (default={default_release})",
     )
     parser.add_argument(
         "--arch",
@@ -132,8 +388,55 @@ def main() -> int:
     parser.add_argument(
         "--rebuild",
         action="store_true",
-        help="forces a rebuild of the package cache "
-        "(requires an Internet connection)",
+        help="forces a rebuild of the package cache of every selected release (requires "
+        "an Internet connection)",
+    )
+    parser.add_argument(
+        "--rebuild-configs",
+        metavar="CONFIGS",
+        help="forces a rebuild of the package caches of a comma-separated list of "
+        "configurations in the form `RELEASE:ARCH` or `OS:RELEASE:ARCH`, or of `all` of "
+        "the available configurations of the package manager, rather than of the "
+        "selected releases; implies `--rebuild`",
+    )
+    parser.add_argument(
+        "--export-image",
+        type=Path,
+        metavar="PATH",
+        help="save the base Docker image of the selected configuration (building it first "
+        "if necessary) to a tarball at PATH, gzipped if PATH ends in `.gz`, so that it "
+        "can be loaded with `--import-image` on machines without network access",
+    )
+    parser.add_argument(
+        "--import-image",
+        type=Path,
+        metavar="PATH",
+        help="load base Docker images from a tarball written by `--export-image` before "
+        "resolving",
+    )
+    parser.add_argument(
+        "--jobs",
+        "-j",
+        type=int,
+        default=4,
+        help="the maximum number of package caches to rebuild concurrently (default=4)",
+    )
+    parser.add_argument(
+        "--cache-format",
+        choices=sorted(CACHE_BACKENDS),
+        default=SQLCache.NAME,
+        help="the on-disk format of the package cache: `sqlite` keeps a database per "
+        "configuration, while `shared-sqlite` stores every configuration of a package "
+        "manager in one database, storing each path and package name once "
+        f"(default={SQLCache.NAME})",
+    )
+    parser.add_argument(
+        "--parallelism",
+        type=int,
+        metavar="N",
+        help="run at most N step containers at once, giving each an equal share of the "
+        "Docker host's CPUs and memory; the limit is shared by every deptective process "
+        "on this machine that uses it (by default, containers run without limits)",
     )
     search_group = parser.add_mutually_exclusive_group()
     search_group.add_argument(
@@ -169,6 +472,70 @@ def main() -> int:
         action="store_true",
         help="enumerate all possible results; equivalent to `--num-results 0`",
     )
+    parser.add_argument(
+        "--format",
+        choices=("text", "ndjson"),
+        default="text",
+        help="the format of the results written to stdout; `ndjson` streams one JSON "
+        "object per result as soon as it is found, with the packages, the missing files "
+        "each package satisfied, and statistics about the search so far, followed by a "
+        "summary object when the resolution ends (default=text)",
+    )
+    parser.add_argument(
+        "--seed",
+        type=Path,
+        metavar="FILE",
+        help="the `--format ndjson` output of a previous run; whenever a file that was "
+        "missing in that run is missing again, the package that was chosen to provide it "
+        "is tried first",
+    )
+    parser.add_argument(
+        "--remote",
+        metavar="URL",
+        help="a cache shared with other machines, either the URL of a `--serve-cache` "
+        "server or a directory; package databases that are missing locally are "
+        "downloaded from it, and the results and dead ends of each resolution are shared "
+        "through it so that later resolutions of the same command skip the dead ends "
+        "and try the earlier results' packages first",
+    )
+    parser.add_argument(
+        "--serve-cache",
+        type=Path,
+        metavar="DIR",
+        help="instead of resolving a command, serve a cache stored in DIR over HTTP for "
+        "use with `--remote`",
+    )
+    parser.add_argument(
+        "--listen",
+        default="127.0.0.1:8786",
+        metavar="HOST:PORT",
+        help="the address at which `--serve-cache` listens (default=127.0.0.1:8786)",
+    )
+    parser.add_argument(
+        "--full-reruns",
+        action="store_true",
+        help="test every candidate package by re-running the whole command; by default, "
+        "when the command fails because one of its subprocesses (such as a single "
+        "compiler invocation) failed, candidates are first tested by re-running only "
+        "that subprocess, and the whole command is only re-run for candidates that "
+        "change its result",
+    )
+    replay_group = parser.add_mutually_exclusive_group()
+    replay_group.add_argument(
+        "--record",
+        type=Path,
+        metavar="DIR",
+        help="record the trace, exit code, output, and file checks of every state explored "
+        "during the resolution to DIR so that it can later be replayed with `--replay`",
+    )
+    replay_group.add_argument(
+        "--replay",
+        type=Path,
+        metavar="DIR",
+        help="resolve the command using a recording made with `--record` instead of "
+        "Docker and the package cache; this fails if the search reaches a state that "
+        "was not recorded",
+    )
     parser.add_argument("command", nargs=argparse.REMAINDER)
 
     log_section = parser.add_argument_group(title="logging")
@@ -185,6 +552,22 @@ def main() -> int:
         action="store_true",
         help="overwrite an existing --log-dir " "if it already exists",
     )
+    log_section.add_argument(
+        "--profile-out",
+        type=Path,
+        required=False,
+        help="path to which to write a timing trace of every phase of the resolution in "
+        "the Chrome trace-event format (viewable with https://ui.perfetto.dev)",
+    )
+    log_section.add_argument(
+        "--metrics-out",
+        type=Path,
+        required=False,
+        help="path to which to write resolution metrics (containers created, images "
+        "committed, installs, cache hit rate, pruned nodes, step latencies) when "
+        "deptective exits; written as JSON if the path ends in `.json`, otherwise in the "
+        "Prometheus text exposition format",
+    )
     log_group = log_section.add_mutually_exclusive_group()
     log_group.add_argument(
         "--log-level",
@@ -207,6 +590,8 @@ def main() -> int:
     )
 
     args = parser.parse_args()
+    if args.rebuild_configs is not None:
+        args.rebuild = True
 
     if args.debug:
         numeric_log_level = logging.DEBUG
@@ -230,6 +615,14 @@ def main() -> int:
 
     traceback.install(show_locals=True)
 
+    if args.profile_out is not None:
+        PROFILER.enable()
+        atexit.register(write_profile, args.profile_out)
+
+    if args.metrics_out is not None:
+        METRICS.exporting = True
+        atexit.register(write_metrics, args.metrics_out)
+
     if args.list:
         list_supported_configurations(console)
         console.print("\n")
@@ -240,59 +633,206 @@ def main() -> int:
         if not args.command:
             return 0
 
-    if not args.command and not args.rebuild:
+    if args.serve_cache is not None:
+        return serve_cache(args.serve_cache, args.listen)
+
+    image_transfer = args.export_image is not None or args.import_image is not None
+
+    if not args.command and not args.rebuild and not image_transfer:
         parser.print_help()
         return 1
 
-    try:
-        cache = load_cache(
-            args.package_manager,
-            args.operating_system,
-            args.release,
-            args.arch,
-            args.rebuild,
-        )
-    except PackageDatabaseNotFoundError as e:
-        if (
-            args.operating_system == default_os
-            and args.release == default_release
-            and args.arch == default_arch
-            and (default_os, default_release, default_arch) != DEFAULT_LINUX
-        ):
-            # we are running on linux that is not supported by the requested package manager
-            cache = None  # type: ignore
-        else:
-            logger.error(
-                f"{e!s}\nPlease make sure that this OS version is still maintained.\n"
-                f"Run `deptective --list` for a list of available OS versions and architectures."
+    releases = [r.strip() for r in args.release.split(",") if r.strip()]
+    if not releases:
+        logger.error("At least one release must be specified")
+        return 1
+
+    if image_transfer:
+        if args.export_image is not None and len(releases) > 1:
+            logger.error("`--export-image` only supports a single release")
+            return 1
+        try:
+            client = docker.from_env()
+            if args.import_image is not None:
+                for image in import_strace_images(client, args.import_image):
+                    logger.info(
+                        f"Imported {', '.join(image.tags) or image.short_id} from "
+                        f"{args.import_image!s}"
+                    )
+            if args.export_image is not None:
+                mgr_class = PackageManager.MANAGERS_BY_NAME[args.package_manager]
+                package_manager = mgr_class(
+                    PackagingConfig(
+                        os=args.operating_system,
+                        os_version=releases[0],
+                        arch=args.arch,
+                    )
+                )
+                export_strace_image(client, package_manager, args.export_image)
+                logger.info(f"Exported the base image to {args.export_image!s}")
+        except DockerException as e:
+            logger.error(f"An error occurred while communicating with Docker: {e!s}")
+            return 1
+        except OSError as e:
+            logger.error(str(e))
+            return 1
+        if not args.command and not args.rebuild:
+            return 0
+
+    remote: Optional[SharedCache] = None
+    if args.remote is not None:
+        try:
+            remote = SharedCache(open_store(args.remote))
+        except (OSError, ValueError) as e:
+            logger.error(f"Unable to open the remote cache {args.remote}: {e!s}")
+            return 1
+
+    cache_class = CACHE_BACKENDS[args.cache_format]
+
+    if args.parallelism is not None and args.command and args.replay is None:
+        if args.parallelism < 1:
+            logger.error("`--parallelism` must be at least 1")
+            return 1
+        try:
+            capacity = HostCapacity.from_client(docker.from_env())
+        except DockerException as e:
+            logger.error(f"An error occurred while communicating with Docker: {e!s}")
+            return 1
+        SCHEDULER.enable(capacity, args.parallelism, CACHE_DIR / "slots")
+
+    seed: List[Decision] = []
+    if args.seed is not None:
+        try:
+            seed = read_seed(args.seed)
+        except (OSError, ValueError, KeyError, AttributeError) as e:
+            logger.error(f"Unable to read the seed {args.seed!s}: {e!s}")
+            return 1
+
+    if args.rebuild and (args.rebuild_configs or len(releases) > 1):
+        try:
+            to_rebuild = rebuild_configurations(
+                args.rebuild_configs or "",
+                args.package_manager,
+                args.operating_system,
+                releases,
+                args.arch,
             )
+        except ValueError as e:
+            logger.error(str(e))
             return 1
-    if cache is None:
-        logger.warning(
-            f"The system OS, release, and/or architecture is not compatible with {args.package_manager}; "
-            f"trying {':'.join(DEFAULT_LINUX)} instead…"
+        errors = rebuild_caches(
+            to_rebuild, cache_class, jobs=args.jobs, console=console
         )
+        failed = False
+        for pm, error in errors.items():
+            if error is not None:
+                failed = True
+                logger.error(
+                    f"Error rebuilding the package cache for {pm.config.os}:"
+                    f"{pm.config.os_version}-{pm.config.arch}: {error!s}"
+                )
+            elif remote is not None and issubclass(cache_class, SQLCache):
+                remote.publish_database(pm)
+        if failed:
+            return 1
+        elif not args.command:
+            return 0
+        # the caches are now fresh, so do not rebuild them again below
+        args.rebuild = False
+
+    if len(releases) > 1 and (args.record is not None or args.replay is not None):
+        logger.error("`--record` and `--replay` only support a single release")
+        return 1
+
+    if len(releases) > 1:
+        caches: Dict[str, Cache] = {}
+        for release in releases:
+            try:
+                caches[release] = load_cache(
+                    args.package_manager,
+                    args.operating_system,
+                    release,
+                    args.arch,
+                    remote=remote,
+                    cache_class=cache_class,
+                )
+            except PackageDatabaseNotFoundError as e:
+                logger.error(
+                    f"{e!s}\nPlease make sure that this OS version is still maintained.\n"
+                    f"Run `deptective --list` for a list of available OS versions and architectures."
+                )
+                return 1
+        return main_multi_release(args, caches, console, seed, remote)
+    args.release = releases[0]
+
+    replay_store: Optional[RecordingStore] = None
+    if args.replay is not None:
+        replay_store = RecordingStore(args.replay)
+        if not replay_store.exists:
+            logger.error(f"{args.replay!s} does not contain a recording")
+            return 1
+        cache: Cache = ReplayCache(replay_store)
+    else:
         try:
             cache = load_cache(
-                args.package_manager, *DEFAULT_LINUX, rebuild=args.rebuild
+                args.package_manager,
+                args.operating_system,
+                args.release,
+                args.arch,
+                args.rebuild,
+                remote=remote,
+                cache_class=cache_class,
             )
-        except PackageDatabaseNotFoundError:
-            logger.error(
-                f"Could not find an OS version and architecture for {args.package_manager}.\n"
-                f"Run `deptective --list` for a list of available OS versions and architectures."
+        except PackageDatabaseNotFoundError as e:
+            if (
+                args.operating_system == default_os
+                and args.release == default_release
+                and args.arch == default_arch
+                and (default_os, default_release, default_arch) != DEFAULT_LINUX
+            ):
+                # we are running on linux that is not supported by the requested package manager
+                cache = None  # type: ignore
+            else:
+                logger.error(
+                    f"{e!s}\nPlease make sure that this OS version is still maintained.\n"
+                    f"Run `deptective --list` for a list of available OS versions and architectures."
+                )
+                return 1
+        if cache is None:
+            logger.warning(
+                f"The system OS, release, and/or architecture is not compatible with {args.package_manager}; "
+                f"trying {':'.join(DEFAULT_LINUX)} instead…"
             )
-            return 1
+            try:
+                cache = load_cache(
+                    args.package_manager,
+                    *DEFAULT_LINUX,
+                    rebuild=args.rebuild,
+                    remote=remote,
+                    cache_class=cache_class,
+                )
+            except PackageDatabaseNotFoundError:
+                logger.error(
+                    f"Could not find an OS version and architecture for {args.package_manager}.\n"
+                    f"Run `deptective --list` for a list of available OS versions and architectures."
+                )
+                return 1
 
     if args.rebuild and not args.command:
         return 0
 
     results: List[SBOM] = []
+    resolutions: List[Resolution] = []
+    commands: Optional[List[List[str]]] = None
 
     # rich has a tendency to gobble stdout, so save the old one before proceeding:
     old_stdout = sys.stdout
 
     success = False
     temp_logdir: Optional[Path] = None
+    generator: Optional[SBOMGenerator] = None
+    found = 0
+    start = time.perf_counter()
 
     try:
 
@@ -332,27 +872,33 @@ def main() -> int:
                 )
                 return 1
 
-        generator = SBOMGenerator(cache=cache, console=console)
+        if replay_store is not None:
+            generator = ReplaySBOMGenerator(replay_store, console=console)
+        elif args.record is not None:
+            generator = RecordingSBOMGenerator(
+                cache, RecordingStore(args.record), console=console
+            )
+        else:
+            generator = SBOMGenerator(cache=cache, console=console)
+            generator.rerun_failing_subprocess = not args.full_reruns
+        generator.add_seed(seed)
 
         if args.multi_step:
-            commands: list[list[str]] = []
-            for path in args.command:
-                try:
-                    with open(path, "r") as f:
-                        for line in f:
-                            line = line.strip()
-                            if not line or line.startswith("#"):
-                                continue
-                            commands.append(shlex.split(line))
-                except (FileNotFoundError, IOError) as e:
-                    logger.error(f"Could not open multi-step file {path}: {e!s}")
-                    return 1
-            sbom_iter = generator.multi_step(*commands)
+            commands = load_multi_step_commands(args.command)
+            if commands is None:
+                return 1
         else:
-            sbom_iter = generator.main(args.command[0], *args.command[1:])
-
-        for i, sbom in enumerate(sbom_iter):
-            if not old_stdout.isatty():
+            commands = [args.command]
+        if remote is not None and replay_store is None:
+            remote.prepare(generator, commands)
+
+        for i, result in enumerate(generator.resolve(*commands)):
+            found += 1
+            resolutions.append(result)
+            sbom = result.sbom
+            if args.format == "ndjson":
+                write_ndjson(old_stdout, {"type": "result", **result.to_json()})
+            elif not old_stdout.isatty():
                 old_stdout.write(str(sbom))
                 old_stdout.write("\n")
                 old_stdout.flush()
@@ -367,11 +913,13 @@ def main() -> int:
                     extra={"markup": True},
                 )
             else:
+                package_manager = generator.cache.package_manager
+                install_command = package_manager.install_command(sbom)
                 logger.info(
                     dedent(
                         f"""\
                 [bold white]Satisfying dependencies:[/bold white] {sbom.rich_str}
-                [bold white]Install with:[/bold white] apt-get install {' '.join(sbom)}"""
+                [bold white]Install with:[/bold white] {install_command}"""
                     ),
                     extra={"markup": True},
                 )
@@ -437,8 +985,25 @@ def main() -> int:
         console.show_cursor()
         return 1
     finally:
-        if not success and temp_logdir is not None:
-            old_stdout.write(f"\n\nA log was saved to {temp_logdir!s}\n")
+        if (
+            remote is not None
+            and replay_store is None
+            and generator is not None
+            and commands is not None
+        ):
+            # share dead ends even if the resolution failed
+            remote.publish(generator, commands, resolutions)
+        saved_logdir = temp_logdir if not success else None
+        if args.format == "ndjson" and not args.search:
+            write_ndjson(
+                old_stdout,
+                ndjson_summary(generator, found, success, start, saved_logdir),
+            )
+            if saved_logdir is not None:
+                # keep stdout valid NDJSON
+                logger.info(f"A log was saved to {saved_logdir!s}")
+        elif saved_logdir is not None:
+            old_stdout.write(f"\n\nA log was saved to {saved_logdir!s}\n")
 
     for sbom in results:
         old_stdout.write(str(sbom))
@@ -3,7 +3,7 @@ import logging
 from pathlib import Path
 import sys
 import time
-from typing import Dict, List, Literal, Optional, TypeVar, Union
+from typing import Any, Dict, List, Literal, Optional, TypeVar, Union
 
 if sys.version_info < (3, 11):
     from typing_extensions import Self
@@ -28,12 +28,23 @@ import docker
 import randomname
 import requests.exceptions  # type: ignore
 from docker.client import DockerClient
-from docker.errors import NotFound
+from docker.errors import APIError, NotFound
 from docker.models.containers import Container as DockerContainer
 from docker.models.images import Image
 from rich.panel import Panel
 from rich.progress import Progress
 
+from .metrics import (
+    CONTAINER_OOM_KILLS,
+    CONTAINER_THROTTLED,
+    CONTAINERS_CREATED,
+    IMAGE_BYTES_COMMITTED,
+    IMAGES_COMMITTED,
+    METRICS,
+)
+from .profiling import span
+from .scheduling import SCHEDULER, Slot
+
 logger = logging.getLogger(__name__)
 
 
@@ -41,12 +52,27 @@ C = TypeVar("C")
 
 
 class Execution:
-    def __init__(self, container: "Container", docker_container: DockerContainer):
+    # the scheduler slot that the container runs in, if scheduling is enabled
+    slot: Optional[Slot] = None
+    # how long the container's CPU quota throttled it, as of the last sample
+    throttled_seconds: float = 0.0
+    oom_killed: bool = False
+    # how often the resource usage of a scheduled container is sampled, in seconds
+    STATS_INTERVAL: float = 2.0
+
+    def __init__(
+        self,
+        container: "Container",
+        docker_container: DockerContainer,
+        slot: Optional[Slot] = None,
+    ):
         self.container: Container = container
         self.docker_container: DockerContainer = docker_container
+        self.slot = slot
         self._closed = False
         self._output: bytes | None = None
         self._exit_code: int | None = None
+        self._last_sample: float = time.monotonic()
 
         logging_driver = docker_container.attrs["HostConfig"]["LogConfig"]["Type"]
 
@@ -67,12 +93,53 @@ class Execution:
             if self.docker_container.status == "exited":
                 self.close()
                 return True
+            if (
+                self.slot is not None
+                and time.monotonic() - self._last_sample >= self.STATS_INTERVAL
+            ):
+                self._sample_stats()
         except NotFound:
             # the container is not running
             self.close()
             return True
         return False
 
+    @property
+    def queue_delay(self) -> float:
+        """How long the container waited for a scheduler slot, in seconds"""
+        if self.slot is None:
+            return 0.0
+        return self.slot.queue_delay
+
+    def _sample_stats(self):
+        self._last_sample = time.monotonic()
+        try:
+            stats = self.docker_container.stats(stream=False, one_shot=True)
+        except (NotFound, APIError):
+            return
+        throttling = stats.get("cpu_stats", {}).get("throttling_data", {})
+        # the counter is cumulative, but reads as zero once the container has exited
+        self.throttled_seconds = max(
+            self.throttled_seconds, throttling.get("throttled_time", 0) / 1e9
+        )
+
+    def _record_limits(self):
+        """Reports how the scheduler's limits affected the container"""
+        try:
+            self.docker_container.reload()
+            self.oom_killed = bool(
+                self.docker_container.attrs.get("State", {}).get("OOMKilled")
+            )
+        except NotFound:
+            pass
+        CONTAINER_THROTTLED.inc(self.throttled_seconds)
+        if self.oom_killed:
+            CONTAINER_OOM_KILLS.inc()
+            logger.warning(
+                f"Container {self.docker_container.id} exceeded its memory limit of "
+                f"{self.slot.mem_limit} bytes; consider a lower `--parallelism`"  # type: ignore
+            )
+
     @functools.cached_property
     def exit_code(self) -> int:
         """Blocks until the execution completes and returns its exit code."""
@@ -97,13 +164,37 @@ class Execution:
                 return b""
         return self._output
 
+    def kill(self):
+        """Terminates the execution if it is still running and then closes it."""
+        if not self._closed:
+            try:
+                self.docker_container.kill()
+            except (NotFound, APIError):
+                # the container already exited
+                pass
+        self.close()
+
     def close(self):
         if self._closed:
             return
         self._closed = True
-        self._output = self.docker_container.logs(stdout=True, stderr=True, tail="all")
-        if self._exit_code is None:
-            self._exit_code = self.docker_container.wait()["StatusCode"]
+        try:
+            self._output = self.docker_container.logs(
+                stdout=True, stderr=True, tail="all"
+            )
+            if self._exit_code is None:
+                self._exit_code = self.docker_container.wait()["StatusCode"]
+            if self.slot is not None:
+                self._record_limits()
+        finally:
+            # the slot and the container must be released even if Docker errors
+            try:
+                self._remove()
+            finally:
+                SCHEDULER.release(self.slot)
+                self.container.__exit__(None, None, None)
+
+    def _remove(self):
         try:
             self.docker_container.remove(force=True)
             logger.debug(
@@ -112,7 +203,6 @@ class Execution:
             self.docker_container.wait(condition="removed")
         except NotFound:
             logger.debug(f"Container {self.docker_container.id} was already removed")
-        self.container.__exit__(None, None, None)
 
     def logs(self, scrollback: int = -1) -> bytes:
         if self.done:
@@ -141,7 +231,7 @@ class Container:
         elif isinstance(parent, Container):
             self.client = parent.client
         else:
-            self.client = docker.from_env(timeout=5)
+            self.client = self.default_client()
         if isinstance(parent, str):
             if image_name is None:
                 if ":" in parent:
@@ -149,7 +239,7 @@ class Container:
                 else:
                     base_name = parent
                 image_name = f"{base_name}-{randomname.get_name()}"
-            parent = self.client.images.get(parent)
+            parent = self.load_image(parent)
         self.parent: Union[Self, Image] = parent
         if isinstance(parent, Container):
             self.level: int = parent.level + 1
@@ -161,6 +251,14 @@ class Container:
             image_name = f"trailofbits/deptective-{randomname.get_name()}"
         self.image_name: str = image_name
 
+    def default_client(self) -> DockerClient:
+        """The client used if none is given and the parent is not a container"""
+        return docker.from_env(timeout=5)
+
+    def load_image(self, name: str) -> Image:
+        """Returns the image of a parent given by name"""
+        return self.client.images.get(name)
+
     @property
     def parent_image(self) -> Image:
         if isinstance(self.parent, Image):
@@ -186,6 +284,10 @@ class Container:
     def setup_image(self, container: DockerContainer):
         pass
 
+    def span_args(self) -> Dict[str, Any]:
+        """Attributes that are attached to every profiling span of this container"""
+        return {"level": self.level, "image": self.image_name}
+
     def files_exist(
         self, *paths: Path | str, progress: Progress | None = None
     ) -> dict[str, bool]:
@@ -193,7 +295,7 @@ class Container:
         if not str_paths:
             return {}
         ret: dict[str, bool] = {path.strip(): True for path in str_paths}
-        with self:
+        with span("files_exist", **self.span_args(), paths=len(str_paths)), self:
             unique_paths = list(str_paths)
             if progress is None:
                 iterator = iter(batched(unique_paths, n=255))
@@ -228,8 +330,10 @@ class Container:
         self,
         command: Union[str, List[str]],
         workdir: str = "/workdir",
-        entrypoint: str = "/bin/bash",
+        entrypoint: str = "/bin/sh",
         additional_volumes: Optional[Dict[str, Dict[str, str]]] = None,
+        environment: Optional[List[str]] = None,
+        slot: Optional[Slot] = None,
     ) -> DockerContainer:
         volumes = self.volumes
         if additional_volumes is not None:
@@ -238,16 +342,20 @@ class Container:
         with self:
             image = self.image.id
 
-            container = self.client.containers.create(
-                image=image,
-                command=command,
-                tty=True,
-                read_only=False,
-                detach=True,
-                volumes=volumes,
-                working_dir=workdir,
-                entrypoint=entrypoint,
-            )
+            with span("container.create", **self.span_args()):
+                container = self.client.containers.create(
+                    image=image,
+                    command=command,
+                    tty=True,
+                    read_only=False,
+                    detach=True,
+                    volumes=volumes,
+                    working_dir=workdir,
+                    entrypoint=entrypoint,
+                    environment=environment,
+                    **(slot.container_limits() if slot is not None else {}),
+                )
+            CONTAINERS_CREATED.inc()
             try:
                 container.start()
 
@@ -268,15 +376,29 @@ class Container:
         self,
         command: Union[str, List[str]],
         workdir: str = "/workdir",
-        entrypoint: str = "/bin/bash",
+        entrypoint: str = "/bin/sh",
+        environment: Optional[List[str]] = None,
     ) -> Execution:
         self.__enter__()
+        try:
+            slot = SCHEDULER.acquire(**self.span_args())
+        except BaseException as e:
+            self.__exit__(type(e), e, None)
+            raise
         try:
             return Execution(
                 self,
-                self.create(command=command, workdir=workdir, entrypoint=entrypoint),
-            )  # this calls self.__exit__(...) when it is complete
-        except RuntimeError as e:
+                self.create(
+                    command=command,
+                    workdir=workdir,
+                    entrypoint=entrypoint,
+                    environment=environment,
+                    slot=slot,
+                ),
+                slot=slot,
+            )  # this calls self.__exit__(...) and releases the slot when it is complete
+        except BaseException as e:
+            SCHEDULER.release(slot)
             self.__exit__(type(e), e, None)
             raise
 
@@ -285,22 +407,45 @@ class Container:
             raise ValueError("The container is already started!")
         if isinstance(self.parent, Container):
             _ = self.parent.__enter__()
+        try:
+            self._build_image()
+        except BaseException:
+            # the image was never built, so `stop` will not release the parent
+            if isinstance(self.parent, Container):
+                self.parent.__exit__(None, None, None)
+            raise
 
-        container = self.client.containers.run(
-            image=self.parent_image,
-            entrypoint="/bin/bash",
-            detach=True,
-            remove=True,
-            tty=True,
-            read_only=False,
-            volumes=self.volumes,
-        )
+    def _build_image(self):
+        slot = SCHEDULER.acquire(**self.span_args())
         try:
-            self.setup_image(container)
+            self._build_image_in(slot)
+        finally:
+            SCHEDULER.release(slot)
+
+    def _build_image_in(self, slot: Optional[Slot]):
+        with span("container.run", **self.span_args()):
+            container = self.client.containers.run(
+                image=self.parent_image,
+                entrypoint="/bin/sh",
+                detach=True,
+                remove=True,
+                tty=True,
+                read_only=False,
+                volumes=self.volumes,
+                **(slot.container_limits() if slot is not None else {}),
+            )
+        CONTAINERS_CREATED.inc()
+        try:
+            with span("setup_image", **self.span_args()):
+                self.setup_image(container)
 
             logger.debug(f"Committing as {self.image_name}:{self.level}...")
-            self._image = container.commit()
-            self._image.tag(repository=self.image_name, tag=self.tag)
+            with span("image.commit", **self.span_args()):
+                self._image = container.commit()
+                self._image.tag(repository=self.image_name, tag=self.tag)
+            IMAGES_COMMITTED.inc()
+            if METRICS.exporting:
+                self._record_image_size(self._image)
         finally:
             try:
                 container.remove(force=True)
@@ -309,12 +454,25 @@ class Container:
             except NotFound:
                 pass
 
+    @staticmethod
+    def _record_image_size(image: Image):
+        try:
+            # the most recent history entry is the layer we just committed
+            history = image.history()
+        except (APIError, requests.exceptions.Timeout) as e:
+            # a metric must never fail the step
+            logger.debug(f"Unable to read the history of {image.id}: {e!s}")
+            return
+        if history:
+            IMAGE_BYTES_COMMITTED.inc(history[0].get("Size", 0))
+
     def stop(self):
         if self._image is None:
             raise ValueError("The container is not running!")
         logger.debug(f"Removing image {self.image_name}:{self.level} ...")
         try:
-            self._image.remove(force=True)
+            with span("image.remove", **self.span_args()):
+                self._image.remove(force=True)
             logger.debug("Removed.")
         except requests.exceptions.Timeout as e:
             logger.warning(f"Timed out waiting for container to be removed: {e!s}")
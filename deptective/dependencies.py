@@ -1,20 +1,25 @@
 import os
+import shlex
 import sys
-import tarfile
 import time
-from io import BytesIO
+from dataclasses import dataclass
 from logging import DEBUG, getLogger
 from pathlib import Path
 from tempfile import TemporaryDirectory
+from threading import Event
 from typing import (
+    Any,
     Dict,
     FrozenSet,
+    Generator,
     Iterable,
     Iterator,
     List,
     Optional,
+    Sequence,
     Set,
     Tuple,
+    Type,
     Union,
 )
 
@@ -26,15 +31,28 @@ from rich.panel import Panel
 from rich.progress import MofNCompleteColumn, Progress, TaskID
 from rich.prompt import Confirm
 
-from .cache import CACHE_DIR, Cache
-from .containers import Container, ContainerProgress, DockerContainer
+from .cache import Cache, normalize_path
+from .containers import (
+    Container,
+    ContainerProgress,
+    DockerContainer,
+    Execution,
+    batched,
+)
 from .exceptions import SBOMGenerationError
-from .strace import ParseError, lazy_parse_paths
+from .images import strace_image
+from .metrics import NODES_PRUNED, PACKAGE_INSTALLS, STEP_DURATION, TRACE_LINES_PARSED
+from .package_manager import merged_usr_path
+from .profiling import instant, span
+from .strace import Invocation, ParseError, ProcessTree, lazy_parse_paths
 
 logger = getLogger(__name__)
 
 
-DEPTECTIVE_STRACE_DIR = Path(__file__).absolute().parent / "strace"
+def prune(rule: str, packages: Iterable[str]):
+    """Counts a node of the search that `rule` pruned and marks it in the profile"""
+    NODES_PRUNED.inc(rule=rule)
+    instant("prune", rule=rule, packages=sorted(packages))
 
 
 class SBOM:
@@ -77,6 +95,69 @@ class SBOM:
         return ", ".join(self.dependencies)
 
 
+@dataclass(frozen=True)
+class Decision:
+    """A choice made along the branch of the search that led to a result: `package` was
+    installed to provide the missing file `path`, in preference to `alternatives`"""
+
+    path: str
+    package: str
+    alternatives: Tuple[str, ...] = ()
+
+    def to_json(self) -> Dict[str, Any]:
+        return {
+            "path": self.path,
+            "package": self.package,
+            "alternatives": list(self.alternatives),
+        }
+
+    @classmethod
+    def from_json(cls, data: Dict[str, Any]) -> "Decision":
+        return cls(
+            path=data["path"],
+            package=data["package"],
+            alternatives=tuple(data.get("alternatives", ())),
+        )
+
+
+@dataclass(frozen=True)
+class InvocationResult:
+    """The outcome of running a single process from a trace on its own"""
+
+    exit_code: int
+    output: bytes
+    missing_files: FrozenSet[str]
+
+
+@dataclass
+class Resolution:
+    """A result of `SBOMGenerator.resolve` along with statistics about the search that
+    found it; the counts are totals for the resolution up to the point the result was
+    found"""
+
+    sbom: SBOM
+    steps_explored: int
+    images_built: int
+    # seconds from the start of the resolution until this result was found
+    wall_time: float
+    # the missing files that each package of the result was chosen to provide
+    satisfied: Dict[str, Tuple[str, ...]]
+    exit_code: int
+    # the choices that led to this result, in the order they were made
+    decisions: Tuple[Decision, ...] = ()
+
+    def to_json(self) -> Dict[str, Any]:
+        return {
+            "packages": list(self.sbom),
+            "steps_explored": self.steps_explored,
+            "images_built": self.images_built,
+            "wall_time": self.wall_time,
+            "satisfied": {p: list(files) for p, files in self.satisfied.items()},
+            "exit_code": self.exit_code,
+            "decisions": [d.to_json() for d in self.decisions],
+        }
+
+
 class NonZeroExit(SBOMGenerationError):
     pass
 
@@ -113,42 +194,63 @@ class IrrelevantPackageInstall(SBOMGenerationError):
     pass
 
 
-def build_context(root_path: Path | str, dockerfile: str) -> BytesIO:
-    fh = BytesIO()
-    with tarfile.open(fileobj=fh, mode="w") as tar:
-
-        def dockerfile_filter(info: tarfile.TarInfo) -> tarfile.TarInfo | None:
-            if info.name in ("Dockerfile", "./Dockerfile"):
-                return None
-            else:
-                return info
-
-        old_cwd = Path.cwd()
-        try:
-            os.chdir(root_path)
-            tar.add(".", recursive=True, filter=dockerfile_filter)
-        finally:
-            os.chdir(old_cwd)
-        dockerfile_utf8 = dockerfile.encode("utf-8")
-        dockerfile_bytes = BytesIO(dockerfile_utf8)
-        dockerfile_bytes.seek(0)
-        info = tarfile.TarInfo(name="./Dockerfile")
-        info.size = len(dockerfile_utf8)
-        tar.addfile(info, dockerfile_bytes)
-    fh.seek(0)
-    return fh
+class ResolutionCancelled(SBOMGenerationError):
+    pass
 
 
 class SBOMGenerator:
-    def __init__(self, cache: Cache, console: Optional[Console] = None):
+    def __init__(
+        self,
+        cache: Cache,
+        console: Optional[Console] = None,
+        interactive: bool = True,
+        hints: Optional[Set[str]] = None,
+    ):
         self._client: Optional[docker.DockerClient] = None
         self._image_name: Optional[str] = None
         if console is None:
             console = Console(log_path=False, file=sys.stderr)
         self.console: Console = console
         self.cache: Cache = cache
+        # when False, no progress is rendered and the user is never prompted; this is
+        # used when several generators run concurrently on the same console
+        self.interactive: bool = interactive
+        # packages that are tried before all others when choosing what to install next;
+        # this set may be shared with (and updated by) other generators
+        if hints is None:
+            hints = set()
+        self.hints: Set[str] = hints
         self.infeasible: Set[SBOM] = set()
         self.feasible: Set[SBOM] = set()
+        self.steps_explored: int = 0
+        self.images_built: int = 0
+        # maps missing files to the package that was chosen to provide them in an earlier
+        # run; those packages are tried first when the same files are missing again
+        self.seed: Dict[str, str] = {}
+        # when True, candidate packages are first tested by re-running only the
+        # subprocess that made the command fail, and the whole command is only re-run if
+        # that subprocess behaves differently
+        self.rerun_failing_subprocess: bool = True
+        self._cancelled: Event = Event()
+
+    @property
+    def cancelled(self) -> bool:
+        return self._cancelled.is_set()
+
+    def cancel(self):
+        """Asks a running resolution to stop at the next opportunity"""
+        self._cancelled.set()
+
+    def add_seed(self, decisions: Iterable[Decision]):
+        """Prefers the packages chosen in `decisions` (e.g., from the results of a previous
+        run) whenever the same files are missing; earlier decisions take precedence"""
+        for decision in decisions:
+            self.seed.setdefault(decision.path, decision.package)
+
+    @property
+    def step_class(self) -> Type["SBOMGeneratorStep"]:
+        """The class used to instantiate every step of a resolution"""
+        return SBOMGeneratorStep
 
     @property
     def image_name(self) -> str:
@@ -168,57 +270,50 @@ class SBOMGenerator:
 
     @property
     def deptective_strace_image(self) -> Image:
-        pm = self.cache.package_manager
-        dockerfile = pm.dockerfile()
-        pm_suffix = f"{pm.NAME}-{pm.config.os}-{pm.config.os_version}-{pm.config.arch}"
-        cached_dockerfile_path = CACHE_DIR / (f"Dockerfile-{pm_suffix}")
-        image_name = f"trailofbits/deptective-strace-{pm_suffix}"
-        if not cached_dockerfile_path.exists():
-            cached_content = ""
+        return strace_image(self.client, self.cache.package_manager)
+
+    def resolve(self, *commands: Sequence[str]) -> Iterator[Resolution]:
+        """Yields every result for running `commands` in order, each as soon as it is
+        found; every command is a sequence of the executable followed by its
+        arguments"""
+        if not commands:
+            raise ValueError("At least one command is required")
+        start = time.perf_counter()
+        if len(commands) == 1:
+            results = self._main(commands[0][0], *commands[0][1:])
         else:
-            with open(cached_dockerfile_path, "r") as f:
-                cached_content = f.read()
-        if dockerfile == cached_content:
-            # the dockerfile hasn't changed
-            for image in self.client.images.list(name=image_name):
-                history = image.history()
-                if history:
-                    creation_time = max(c["Created"] for c in image.history())
-                    if any(
-                        creation_time < (DEPTECTIVE_STRACE_DIR / source).stat().st_mtime
-                        for source in ("deptective-strace", "deptective-files-exist")
-                    ):
-                        # it needs to be rebuilt!
-                        break
-                return image
-        # we need to build the image!
-        logger.info(
-            "Building the base Docker image…\n"
-            "This is a one-time operation that may take a few minutes."
-        )
-        result = self.client.images.build(
-            fileobj=build_context(str(DEPTECTIVE_STRACE_DIR), dockerfile),
-            dockerfile="./Dockerfile",
-            custom_context=True,
-            tag=image_name,
-            rm=True,
-            pull=True,
-        )[0]
-        with open(cached_dockerfile_path, "w") as f:
-            f.write(dockerfile)
-        return result
+            results = self._multi_step_results(*(list(c) for c in commands))
+        try:
+            for sbom, step in results:
+                satisfied = step.satisfied_files
+                yield Resolution(
+                    sbom=sbom,
+                    steps_explored=self.steps_explored,
+                    images_built=self.images_built,
+                    wall_time=time.perf_counter() - start,
+                    satisfied={p: satisfied.get(p, ()) for p in sbom},
+                    exit_code=step.retval,
+                    decisions=tuple(step.decisions),
+                )
+        finally:
+            results.close()
 
     def multi_step(self, *commands: list[str]) -> Iterator[SBOM]:
-        first_step = SBOMGeneratorStep(self, commands[0][0], commands[0][1:])
+        for sbom, _ in self._multi_step_results(*commands):
+            yield sbom
+
+    def _multi_step_results(
+        self, *commands: list[str]
+    ) -> Generator[tuple[SBOM, "SBOMGeneratorStep"], None, None]:
+        first_step = self.step_class(self, commands[0][0], commands[0][1:])
         commands_task = first_step.progress.add_task(
             description=":computer: commands", total=len(commands)
         )
         with first_step as step:
             try:
-                for sbom, _ in self._multi_step(
+                yield from self._multi_step(
                     *commands, prev_step=step, commands_task=commands_task
-                ):
-                    yield sbom
+                )
             finally:
                 first_step.progress.remove_task(commands_task)
 
@@ -239,7 +334,7 @@ class SBOMGenerator:
                         # we are done!
                         yield sbom, sbom_step
                     else:
-                        next_step = SBOMGeneratorStep(
+                        next_step = self.step_class(
                             self, commands[1][0], commands[1][1:], parent=sbom_step
                         )
                         with next_step:
@@ -260,9 +355,9 @@ class SBOMGenerator:
         command: str,
         *args: str,
         existing_step: Optional["SBOMGeneratorStep"] = None,
-    ) -> Iterator[tuple[SBOM, "SBOMGeneratorStep"]]:
+    ) -> Generator[tuple[SBOM, "SBOMGeneratorStep"], None, None]:
         if existing_step is None:
-            existing_step = SBOMGeneratorStep(self, command, args)
+            existing_step = self.step_class(self, command, args)
         with existing_step as step:
             yielded = False
             error: Exception | KeyboardInterrupt | None = None
@@ -281,7 +376,12 @@ class SBOMGenerator:
         if error is None:
             return
 
-        if sys.stdin.isatty() and not yielded and best_sbom is not None:
+        if (
+            self.interactive
+            and sys.stdin.isatty()
+            and not yielded
+            and best_sbom is not None
+        ):
             if not isinstance(error, KeyboardInterrupt):
                 logger.error(str(error))
                 prompt = "Would you like to see the most promising SBOM before the error is handled?"
@@ -354,9 +454,18 @@ class SBOMGeneratorStep(Container):
                 console=generator.console,
                 transient=True,
                 expand=True,
+                disable=not generator.interactive,
             )
         self._command_output: Optional[bytes] = None
         self.missing_files: List[str] = []
+        # every absolute path that the traced command accessed, or None before it runs
+        self.accessed_files: Optional[FrozenSet[str]] = None
+        # the processes of the traced command
+        self.processes: Optional[ProcessTree] = None
+        self._focus: Optional[Tuple[Invocation, InvocationResult]] = None
+        self._focus_checked: bool = False
+        # the packages that provide each missing file, according to the cache
+        self.candidates: Dict[str, FrozenSet[str]] = {}
         self._task: Optional[TaskID] = None
 
     @property
@@ -426,6 +535,48 @@ class SBOMGeneratorStep(Container):
             node = node.parent
         return s
 
+    @property
+    def satisfied_files(self) -> Dict[str, Tuple[str, ...]]:
+        """Maps every package installed on the way to this step to the missing files of
+        the preceding step that the package was chosen to provide"""
+        satisfied: Dict[str, Tuple[str, ...]] = {}
+        node: Optional[SBOMGeneratorStep] = self
+        while isinstance(node, SBOMGeneratorStep):
+            parent = node.parent
+            if isinstance(parent, SBOMGeneratorStep):
+                for package in node.preinstall:
+                    satisfied[package] = tuple(
+                        f
+                        for f in parent.missing_files_without_duplicates
+                        if package in parent.candidates.get(f, ())
+                    )
+            node = parent  # type: ignore
+        return satisfied
+
+    @property
+    def decisions(self) -> List[Decision]:
+        """The decisions made on the way to this step, from the first to the last"""
+        decisions: List[Decision] = []
+        node: Optional[SBOMGeneratorStep] = self
+        while isinstance(node, SBOMGeneratorStep):
+            parent = node.parent
+            if isinstance(parent, SBOMGeneratorStep):
+                for package in sorted(node.preinstall, reverse=True):
+                    for path in parent.missing_files_without_duplicates:
+                        candidates = parent.candidates.get(path, frozenset())
+                        if package in candidates:
+                            decisions.append(
+                                Decision(
+                                    path=path,
+                                    package=package,
+                                    alternatives=tuple(sorted(candidates - {package})),
+                                )
+                            )
+                            break
+            node = parent  # type: ignore
+        decisions.reverse()
+        return decisions
+
     def _register_infeasible(self):
         sbom = self.sbom
         if sbom:
@@ -442,43 +593,173 @@ class SBOMGeneratorStep(Container):
             partial_sbom=self.best_sbom.sbom,
         )
 
+    @property
+    def trace_log(self) -> Path:
+        """The path on the host to which the strace log of the command is written"""
+        if self._logdir is None:
+            raise ValueError("The step is not running!")
+        return self._logdir / "deptective.txt"
+
+    def trace(self) -> Execution:
+        """Runs the command under strace and waits for it to complete"""
+        # only trace processes in detail if a failing subprocess may be re-run
+        options = ["--processes"] if self.generator.rerun_failing_subprocess else []
+        logger.debug(
+            f"deptective-strace {' '.join(options + ['/log/deptective.txt'])}"
+            f" {self.full_command}"
+        )
+        with span("run", **self.span_args()) as attrs:
+            exe = self.run(
+                options + ["/log/deptective.txt", self.command] + list(self.args),
+                entrypoint="/usr/bin/deptective-strace",
+                workdir="/workdir",
+            )
+            self.progress.execute(
+                exe,
+                title=self.full_command,
+                subtitle=self.sbom.rich_str,
+                scrollback=5,
+            )
+            self._wait(exe)
+            self.retval = exe.exit_code
+            attrs["exit_code"] = self.retval
+            self._report_scheduling(exe, attrs)
+        return exe
+
+    def _report_scheduling(self, exe: Execution, attrs: Dict[str, Any]):
+        if exe.slot is None:
+            return
+        attrs["queue_delay"] = exe.queue_delay
+        attrs["throttled_seconds"] = exe.throttled_seconds
+        attrs["oom_killed"] = exe.oom_killed
+        logger.debug(
+            f"`{self.full_command}` waited {exe.queue_delay:.2f}s for slot "
+            f"{exe.slot.index} and was throttled for {exe.throttled_seconds:.2f}s"
+        )
+
+    def _wait(self, exe: Execution):
+        while not exe.done:
+            if self.generator.cancelled:
+                exe.kill()
+                raise ResolutionCancelled(
+                    f"Resolution of `{self.full_command}` was cancelled"
+                )
+            self.progress.refresh()
+            time.sleep(0.5)
+
+    def run_invocation(self, invocation: Invocation) -> InvocationResult:
+        """Runs a single process from an earlier trace on its own, under strace"""
+        logger.debug(
+            f"deptective-strace --processes /log/invocation.txt {invocation!s}"
+        )
+        with span("run invocation", **self.span_args()) as attrs:
+            exe = self.run(
+                ["--processes", "/log/invocation.txt", invocation.executable]
+                + list(invocation.argv[1:]),
+                entrypoint="/usr/bin/deptective-strace",
+                workdir=invocation.cwd,
+                environment=list(invocation.env),
+            )
+            self._wait(exe)
+            attrs["exit_code"] = exe.exit_code
+            self._report_scheduling(exe, attrs)
+        with open(self.trace_log.parent / "invocation.txt") as log:
+            processes = ProcessTree.from_lines(log, cwd=invocation.cwd)
+        return InvocationResult(
+            exit_code=exe.exit_code,
+            output=exe.output,
+            missing_files=processes.missing_files,
+        )
+
+    @property
+    def focus(self) -> Optional[Tuple[Invocation, InvocationResult]]:
+        """The subprocess that made this step's command fail, along with the result of
+        running it on its own in this step's image, if that reproduces the failure. It
+        is only determined once a child step needs it."""
+        if not self._focus_checked:
+            self._focus_checked = True
+            self._focus = self._find_focus()
+        return self._focus
+
+    def _find_focus(self) -> Optional[Tuple[Invocation, InvocationResult]]:
+        if self.processes is None or self.retval == 0:
+            return None
+        invocation = self.processes.failing_invocation(self.missing_files)
+        if invocation is None:
+            return None
+        with self:
+            baseline = self.run_invocation(invocation)
+        # the invocation may depend on files that the command created and removed, such
+        # as a configure test's source file, in which case it fails differently alone
+        if (
+            baseline.exit_code != invocation.exit_code
+            or not baseline.missing_files <= invocation.missing_files
+        ):
+            logger.debug(f"`{invocation!s}` does not fail the same way on its own")
+            return None
+        logger.info(
+            f"Testing candidate packages for `{self.full_command}` by re-running"
+            f" `{invocation!s}`"
+        )
+        return invocation, baseline
+
+    def _check_focus_relevance(self, parent: "SBOMGeneratorStep"):
+        """Raises `IrrelevantPackageInstall` if the subprocess that made the parent's
+        command fail behaves exactly the same with this step's packages installed"""
+        focus = parent.focus
+        if focus is None:
+            return
+        invocation, baseline = focus
+        if self.run_invocation(invocation) != baseline:
+            return
+        prune("subprocess", self.preinstall)
+        logger.info(
+            f"Installing {', '.join(self.preinstall)} at this point is useless because"
+            f" `{invocation!s}` has the same result with or without it"
+        )
+        raise IrrelevantPackageInstall(
+            f"`{invocation!s}` exited with code {baseline.exit_code} regardless of the"
+            f" install of package(s) {', '.join(self.preinstall)}"
+        )
+
     def find_feasible_sboms(self) -> Iterator[tuple[SBOM, "SBOMGeneratorStep"]]:
         logger.debug(f"Running step {self.level}...")
+        self.generator.steps_explored += 1
+        step_start = time.perf_counter()
         with self:
             # open a context so we keep the container running after the `self.run` command
             # so we can query it for missing files
+            parent = self.traced_parent
+            if parent is not None and self.generator.rerun_failing_subprocess:
+                self._check_focus_relevance(parent)
             try:
-                logger.debug(
-                    f"deptective-strace /log/deptective.txt {self.full_command}"
-                )
-                exe = self.run(
-                    ["/log/deptective.txt", self.command] + list(self.args),
-                    entrypoint="/usr/bin/deptective-strace",
-                    workdir="/workdir",
-                )
-                self.progress.execute(
-                    exe,
-                    title=self.full_command,
-                    subtitle=self.sbom.rich_str,
-                    scrollback=5,
-                )
-                while not exe.done:
-                    self.progress.refresh()
-                    time.sleep(0.5)
-                self.retval = exe.exit_code
+                exe = self.trace()
                 self.command_output = exe.output
             finally:
                 logger.debug(f"Ran, exit code {self.retval}")
             accessed_files: set[str] = set()
-            with open(self._logdir / "deptective.txt") as log:  # type: ignore
+            processes: Optional[ProcessTree] = None
+            if self.retval != 0 and self.generator.rerun_failing_subprocess:
+                processes = ProcessTree()
+            with span("parse trace", **self.span_args()) as attrs, open(
+                self.trace_log
+            ) as log:
+                lines = 0
                 for line in log:
+                    lines += 1
                     try:
                         for arg in lazy_parse_paths(line):
                             if arg.startswith("/"):
                                 accessed_files.add(arg)
+                        if processes is not None:
+                            processes.feed(line)
                     except ParseError as e:
                         logger.warning(str(e))
                         continue
+                attrs["accessed_files"] = len(accessed_files)
+            TRACE_LINES_PARSED.inc(lines)
+            self.accessed_files = frozenset(accessed_files)
+            self.processes = processes
 
             new_missing_files = self._missing_files(exe.container, *accessed_files)
             for path in new_missing_files:
@@ -490,6 +771,7 @@ class SBOMGeneratorStep(Container):
                         self.missing_files.append(resolved)
                         continue
                 self.missing_files.append(path)
+        STEP_DURATION.observe(time.perf_counter() - step_start)
         if self.retval == 0:
             yield SBOM(), self
             return
@@ -508,35 +790,54 @@ class SBOMGeneratorStep(Container):
                 f"Installing {', '.join(self.preinstall)} at this point is useless"
                 f" because `{self.full_command}` has the same output with or without it"
             )
+            prune("irrelevant", self.preinstall)
             raise IrrelevantPackageInstall(
                 f"`{self.full_command}` exited with code {self.retval} regardless of the"
                 f" install of package(s) {', '.join(self.preinstall)}"
             )
         packages_to_try: Dict[str, tuple[int, int]] = {}
-        for i, file in enumerate(self.missing_files):
-            for possibility in self.generator.cache[file]:
-                if possibility in self.tried_packages or possibility in self.preinstall:
-                    # we already tried this package
-                    continue
-                elif possibility in packages_to_try:
-                    packages_to_try[possibility] = (
-                        packages_to_try[possibility][0] + 1,
-                        i,
-                    )
-                else:
-                    packages_to_try[possibility] = (1, i)
+        with span(
+            "cache lookups", **self.span_args(), files=len(self.missing_files)
+        ) as attrs:
+            providers = self.generator.cache.lookup_many(self.missing_files)
+            for i, file in enumerate(self.missing_files):
+                self.candidates[file] = providers[normalize_path(file)]
+                for possibility in self.candidates[file]:
+                    if (
+                        possibility in self.tried_packages
+                        or possibility in self.preinstall
+                    ):
+                        # we already tried this package
+                        continue
+                    elif possibility in packages_to_try:
+                        packages_to_try[possibility] = (
+                            packages_to_try[possibility][0] + 1,
+                            i,
+                        )
+                    else:
+                        packages_to_try[possibility] = (1, i)
+            attrs["candidates"] = len(packages_to_try)
         if not packages_to_try:
             self._register_infeasible()  # this always raises an exception
         yielded = False
         last_error: Optional[SBOMGenerationError] = None
         if self._task is not None:
             self.progress.update(self._task, total=len(packages_to_try))  # type: ignore
-        for _, _, package in sorted(
-            ((count, idx, name) for name, (count, idx) in packages_to_try.items()),
+        hints = self.generator.hints
+        seeded = {
+            self.generator.seed[f]
+            for f in self.missing_files
+            if f in self.generator.seed
+        }
+        for _, _, _, _, package in sorted(
+            (
+                (name in seeded, name in hints, count, idx, name)
+                for name, (count, idx) in packages_to_try.items()
+            ),
             reverse=True,
         ):
             try:
-                step = SBOMGeneratorStep(
+                step = self.generator.step_class(
                     generator=self.generator,
                     command=self.command,
                     arguments=self.args,
@@ -549,6 +850,7 @@ class SBOMGeneratorStep(Container):
                         f"Skipping substep {package} because we already know that it is"
                         " infeasible"
                     )
+                    prune("infeasible", step.preinstall)
                     continue
                 elif any(step.sbom.issuperset(f) for f in self.generator.feasible):
                     # this next step would produce a superset of an already known-good
@@ -557,6 +859,7 @@ class SBOMGeneratorStep(Container):
                         f"Skipping substep {package} because it is a superset of an"
                         " already discovered feasible solution"
                     )
+                    prune("superset", step.preinstall)
                     continue
                 with step as substep:
                     try:
@@ -565,8 +868,13 @@ class SBOMGeneratorStep(Container):
                                 self.progress.update(self._task, advance=1)  # type: ignore
                             yield SBOM((package,)) + sbom, ss
                             yielded = True
+                    except ResolutionCancelled:
+                        raise
                     except SBOMGenerationError:
                         last_error = last_error
+            except IrrelevantPackageInstall:
+                # the package installed nothing that the command accessed
+                continue
             except PreinstallError as e:
                 # package was unable to be installed, so skip it
                 if e.output is not None and b"enough free space" in e.output:
@@ -611,7 +919,8 @@ class SBOMGeneratorStep(Container):
     def setup_image(self, container: DockerContainer):
         if self.level == 0:
             logger.info("Copying source files to the container...")
-            retval, output = container.exec_run("cp -r /src /workdir")
+            with span("copy sources", **self.span_args()):
+                retval, output = container.exec_run("cp -r /src /workdir")
             if retval != 0:
                 raise ValueError(
                     "Error copying the source files to /workdir in the Docker image:"
@@ -620,7 +929,8 @@ class SBOMGeneratorStep(Container):
             logger.info(
                 f"Updating {self.generator.cache.package_manager.NAME} sources..."
             )
-            retval, output = self.generator.cache.package_manager.update(container)
+            with span("update", **self.span_args()):
+                retval, output = self.generator.cache.package_manager.update(container)
             if retval != 0:
                 raise ValueError(f"Error updating packages: {output!r}")
             # add the command and its relevant arguments to the missing files:
@@ -639,16 +949,103 @@ class SBOMGeneratorStep(Container):
                 for path in (p.strip() for p in output.decode("utf-8").split(":")):
                     self.missing_files.append(str(Path(path) / self.command))
         if self.preinstall:
+            package_manager = self.generator.cache.package_manager
+            installed_before: Optional[FrozenSet[str]] = None
+            if self.traced_parent is not None:
+                installed_before = package_manager.installed_packages(container)
             logger.info(
                 f"Installing {', '.join(self.preinstall)} into {container.short_id}..."
             )
-            retval, output = self.generator.cache.package_manager.install(
-                container, *self.preinstall
-            )
+            with span("install", **self.span_args()) as attrs:
+                retval, output = package_manager.install(container, *self.preinstall)
+                attrs["exit_code"] = retval
+            PACKAGE_INSTALLS.inc(result="success" if retval == 0 else "failure")
             if retval != 0:
                 raise PreinstallError(
                     f"Error installing {' '.join(self.preinstall)}: {output!r}", output
                 )
+            if installed_before is not None:
+                self._check_install_relevance(container, installed_before)
+        self.generator.images_built += 1
+
+    @property
+    def traced_parent(self) -> Optional["SBOMGeneratorStep"]:
+        """The parent step if it already traced the same command as this step"""
+        parent = self.parent
+        if (
+            isinstance(parent, SBOMGeneratorStep)
+            and parent.accessed_files is not None
+            and parent.command == self.command
+            and parent.args == self.args
+        ):
+            return parent
+        return None
+
+    def _existing_files(
+        self, container: DockerContainer, paths: Iterable[str]
+    ) -> Optional[Set[str]]:
+        """Returns which of `paths` exist in `container`, or None if that is unknown"""
+        existing: Set[str] = set()
+        for files in batched(sorted(set(paths)), 255):
+            retval, output = container.exec_run(
+                shlex.join(["/usr/bin/deptective-files-exist", *files])
+            )
+            if retval != 0:
+                return None
+            missing = {line.strip() for line in output.decode("utf-8").splitlines()}
+            existing.update(f for f in files if f not in missing)
+        return existing
+
+    def _check_install_relevance(
+        self, container: DockerContainer, installed_before: FrozenSet[str]
+    ):
+        """Raises `IrrelevantPackageInstall` if the packages that were just installed
+        (including any dependencies they pulled in) neither created a file that was
+        missing when the parent ran the command nor installed any other path that the
+        command accessed, in which case the command would behave exactly as it did in the
+        parent and there is no need to commit the image and trace it again"""
+        parent = self.traced_parent
+        assert parent is not None and parent.accessed_files is not None
+        package_manager = self.generator.cache.package_manager
+        with span("predict relevance", **self.span_args()) as attrs:
+            installed = package_manager.installed_packages(container)
+            if installed is None:
+                return
+            new_packages = installed - installed_before
+            manifest = package_manager.package_files(container, new_packages)
+            if manifest is None:
+                return
+            attrs["packages"] = len(new_packages)
+            # package managers also list every directory leading to the files they
+            # install, which must be kept: a command that listed one of them (e.g., to
+            # scan for plugins) may see the new entries
+            installed_paths = {
+                merged_usr_path(path) for path in manifest if path not in ("/", "/.")
+            }
+            if any(
+                merged_usr_path(os.path.normpath(path)) in installed_paths
+                for path in parent.accessed_files
+            ):
+                return
+            created = self._existing_files(container, parent.missing_files)
+            if created is None or created:
+                return
+        prune("manifest", self.preinstall)
+        logger.info(
+            f"Installing {', '.join(self.preinstall)} at this point is useless because it"
+            f" installs nothing that `{self.full_command}` accessed"
+        )
+        raise IrrelevantPackageInstall(
+            f"The install of package(s) {', '.join(self.preinstall)} cannot change the"
+            f" behavior of `{self.full_command}`"
+        )
+
+    def span_args(self) -> Dict[str, Any]:
+        return {
+            **super().span_args(),
+            "command": self.full_command,
+            "packages": sorted(self.preinstall),
+        }
 
     def complete_task(self):
         if self._task is not None:
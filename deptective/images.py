@@ -0,0 +1,195 @@
+import gzip
+import hashlib
+import re
+import tarfile
+from io import BytesIO
+from logging import getLogger
+from pathlib import Path
+from tempfile import TemporaryFile
+from typing import IO, List, Tuple
+
+import docker
+from docker.errors import APIError, ImageNotFound
+from docker.models.images import Image
+
+from .package_manager import PackageManager
+
+logger = getLogger(__name__)
+
+
+DEPTECTIVE_STRACE_DIR = Path(__file__).absolute().parent / "strace"
+# the label of the base image that records the digest of the context it was built from,
+# before its parent images were pinned
+CONTEXT_DIGEST_LABEL = "com.trailofbits.deptective.context-digest"
+# the image reference in every `FROM` line of a Dockerfile
+FROM_IMAGE = re.compile(r"^(FROM\s+)(\S+)", re.MULTILINE | re.IGNORECASE)
+
+
+def _tarinfo(name: str, size: int, mode: int) -> tarfile.TarInfo:
+    # every entry has the same owner and timestamp so that the context only depends on
+    # the names, permissions, and contents of its files
+    info = tarfile.TarInfo(name=name)
+    info.size = size
+    info.mode = mode
+    info.mtime = 0
+    info.uid = info.gid = 0
+    info.uname = info.gname = ""
+    return info
+
+
+def build_context(root_path: Path | str, dockerfile: str) -> IO[bytes]:
+    """Writes a Docker build context of every file in `root_path` plus `dockerfile` to a
+    temporary file and returns it, open at its start.
+
+    The context is deterministic: identical inputs always produce identical bytes.
+
+    """
+    root_path = Path(root_path)
+    fh = TemporaryFile()
+    try:
+        with tarfile.open(fileobj=fh, mode="w", format=tarfile.GNU_FORMAT) as tar:
+            for path in sorted(p for p in root_path.rglob("*") if p.is_file()):
+                name = path.relative_to(root_path).as_posix()
+                if name == "Dockerfile":
+                    continue
+                mode = 0o755 if path.stat().st_mode & 0o111 else 0o644
+                with open(path, "rb") as f:
+                    tar.addfile(_tarinfo(name, path.stat().st_size, mode), f)
+            dockerfile_utf8 = dockerfile.encode("utf-8")
+            tar.addfile(
+                _tarinfo("Dockerfile", len(dockerfile_utf8), 0o644),
+                BytesIO(dockerfile_utf8),
+            )
+        fh.seek(0)
+    except BaseException:
+        fh.close()
+        raise
+    return fh
+
+
+def _digest(fh: IO[bytes]) -> str:
+    h = hashlib.sha256()
+    for chunk in iter(lambda: fh.read(1024 * 1024), b""):
+        h.update(chunk)
+    fh.seek(0)
+    return h.hexdigest()
+
+
+def strace_image_repository(package_manager: PackageManager) -> str:
+    """The repository of the base images for `package_manager`; images built from other
+    sources get their own repository, so that they never replace (or prune) the default
+    ones"""
+    config = package_manager.config
+    return package_manager.with_sources_id(
+        f"trailofbits/deptective-strace-{package_manager.NAME}-{config.os}-"
+        f"{config.os_version}-{config.arch}"
+    )
+
+
+def pin_parent_images(client: docker.DockerClient, dockerfile: str) -> str:
+    """Replaces the image in every `FROM` line of `dockerfile` with its digest, pulling
+    the image if it is not present, so that the build does not depend on where a
+    floating tag such as `ubuntu:noble` points at the time"""
+
+    def pin(match: re.Match) -> str:
+        reference = match.group(2)
+        if "@" in reference or reference.lower() == "scratch":
+            return match.group(0)
+        try:
+            image = client.images.get(reference)
+        except ImageNotFound:
+            image = client.images.pull(reference)
+        repository = reference.rsplit(":", 1)[0] if ":" in reference else reference
+        digests: List[str] = image.attrs.get("RepoDigests") or []
+        for digest in digests:
+            if digest.startswith(f"{repository}@"):
+                return f"{match.group(1)}{digest}"
+        # the image was built locally, so it has no digest in a registry
+        logger.warning(f"Unable to pin the parent image {reference} to a digest")
+        return match.group(0)
+
+    return FROM_IMAGE.sub(pin, dockerfile)
+
+
+def _strace_image(
+    client: docker.DockerClient, package_manager: PackageManager
+) -> Tuple[Image, str]:
+    repository = strace_image_repository(package_manager)
+    dockerfile = package_manager.dockerfile()
+    with build_context(DEPTECTIVE_STRACE_DIR, dockerfile) as context:
+        digest = _digest(context)
+    # an image built (or imported) from the same context is reused, so that the parent
+    # images are only resolved once rather than whenever their tags move
+    for image in client.images.list(
+        name=repository, filters={"label": f"{CONTEXT_DIGEST_LABEL}={digest}"}
+    ):
+        for tag in image.tags:
+            if tag.startswith(f"{repository}:"):
+                return image, tag
+    logger.info(
+        "Building the base Docker image…\n"
+        "This is a one-time operation that may take a few minutes."
+    )
+    # the tag is a hash of the context with the parent images pinned, so it identifies
+    # everything the image was built from other than the package indexes that
+    # `apt-get update` fetches during the build
+    with build_context(
+        DEPTECTIVE_STRACE_DIR, pin_parent_images(client, dockerfile)
+    ) as context:
+        tag = f"{repository}:{_digest(context)[:16]}"
+        # the parent images were resolved above, so do not pull them again
+        image = client.images.build(
+            fileobj=context,
+            dockerfile="Dockerfile",
+            custom_context=True,
+            tag=tag,
+            labels={CONTEXT_DIGEST_LABEL: digest},
+            rm=True,
+            pull=False,
+        )[0]
+    prune_strace_images(client, package_manager, digest)
+    return image, tag
+
+
+def strace_image(client: docker.DockerClient, package_manager: PackageManager) -> Image:
+    """Returns the base image for `package_manager`, building it if necessary"""
+    return _strace_image(client, package_manager)[0]
+
+
+def prune_strace_images(
+    client: docker.DockerClient, package_manager: PackageManager, digest: str
+):
+    """Removes the base images for `package_manager` that were built from any context
+    other than `digest`, i.e., by other versions of Deptective"""
+    for image in client.images.list(name=strace_image_repository(package_manager)):
+        if image.labels.get(CONTEXT_DIGEST_LABEL) == digest:
+            continue
+        try:
+            client.images.remove(image.id)
+            logger.debug(f"Removed the outdated base image {', '.join(image.tags)}")
+        except APIError as e:
+            # e.g., it is still used by a container
+            logger.debug(f"Unable to remove the base image {image.id}: {e!s}")
+
+
+def export_strace_image(
+    client: docker.DockerClient, package_manager: PackageManager, path: Path
+) -> Image:
+    """Saves the base image for `package_manager` (building it first if necessary) to a
+    tarball at `path`, which is gzipped if `path` ends in `.gz`"""
+    image, tag = _strace_image(client, package_manager)
+    if path.suffix == ".gz":
+        out: IO[bytes] = gzip.open(path, "wb")  # type: ignore
+    else:
+        out = open(path, "wb")
+    with out:
+        for chunk in image.save(named=tag):
+            out.write(chunk)
+    return image
+
+
+def import_strace_images(client: docker.DockerClient, path: Path) -> List[Image]:
+    """Loads the images in a tarball written by `export_strace_image`"""
+    # the Docker daemon transparently decompresses gzipped tarballs
+    with open(path, "rb") as f:
+        return client.images.load(f)
@@ -1,8 +1,13 @@
-import io
+import hashlib
+import http.client
+import json
+import time
 import urllib.request
 from logging import Handler, Logger, getLogger
 from pathlib import Path
-from typing import BinaryIO, Iterator, Optional
+from tempfile import TemporaryDirectory
+from typing import BinaryIO, Dict, Iterator, Optional
+from urllib.error import HTTPError, URLError
 from urllib.parse import urlparse
 
 from rich.console import Console
@@ -34,31 +39,142 @@ def get_console(logger: Logger) -> Console:
     return Console()
 
 
-class Download(io.RawIOBase):
-    def __init__(self, progress: "DownloadWithProgress"):
+class DownloadVerificationError(RuntimeError):
+    pass
+
+
+def file_sha256(path: Path) -> str:
+    h = hashlib.sha256()
+    with open(path, "rb") as f:
+        for chunk in stream_iterator(f, chunk_size=1024 * 1024):  # type: ignore
+            h.update(chunk)
+    return h.hexdigest()
+
+
+class Download:
+    """Downloads a URL to a local file, resuming with HTTP Range requests on failure.
+
+    The partial download is kept in `{destination}.part` (with the server's validators
+    saved alongside it in `{destination}.part.json`), so an interrupted download can
+    also be resumed by a later process.
+
+    """
+
+    def __init__(self, progress: "DownloadWithProgress", destination: Path):
         self._progress: DownloadWithProgress = progress
+        self.destination: Path = destination
+        self.partial: Path = destination.with_name(f"{destination.name}.part")
+        self.validators: Path = destination.with_name(f"{destination.name}.part.json")
         self._task_id: TaskID = progress.progress.add_task(
             "download", filename=progress.filename, start=False
         )
-        self._response = urllib.request.urlopen(progress.url)
-        self._progress.progress.update(
-            self._task_id, total=int(self._response.info()["Content-length"])
-        )
-        self._progress.progress.start_task(self._task_id)
 
-    def __getattr__(self, item):
+    def _load_validator(self) -> Optional[str]:
+        if not self.validators.exists():
+            return None
         try:
-            return getattr(self._response, item)
-        except AttributeError:
-            pass
-        raise AttributeError(
-            f"'{self.__class__.__name__}' object has no attribute '{item!s}'"
-        )
+            with open(self.validators, "r") as f:
+                validators = json.load(f)
+        except (OSError, ValueError):
+            return None
+        if validators.get("url") != self._progress.url:
+            return None
+        return validators.get("etag") or validators.get("last-modified")
+
+    def _save_validator(self, response):
+        with open(self.validators, "w") as f:
+            json.dump(
+                {
+                    "url": self._progress.url,
+                    "etag": response.headers.get("ETag"),
+                    "last-modified": response.headers.get("Last-Modified"),
+                },
+                f,
+            )
 
-    def read(self, size: int = -1, /) -> bytes | None:
-        ret = self._response.read(size)
-        self._progress.progress.update(self._task_id, advance=len(ret))
-        return ret
+    def _discard_partial(self):
+        for path in (self.partial, self.validators):
+            if path.exists():
+                path.unlink()
+
+    def _fetch_once(self):
+        progress = self._progress.progress
+        offset = self.partial.stat().st_size if self.partial.exists() else 0
+        validator = self._load_validator()
+        headers: Dict[str, str] = {}
+        if offset and validator is not None:
+            headers["Range"] = f"bytes={offset}-"
+            # only resume if the file on the server has not changed in the meantime
+            headers["If-Range"] = validator
+        else:
+            offset = 0
+        request = urllib.request.Request(self._progress.url, headers=headers)
+        with urllib.request.urlopen(request, timeout=60) as response:
+            if response.status != 206:
+                # the server sent the whole file
+                offset = 0
+            else:
+                _logger.info(f"Resuming the download of {self._progress.filename}…")
+            self._save_validator(response)
+            length = response.headers.get("Content-Length")
+            progress.update(
+                self._task_id,
+                total=None if length is None else offset + int(length),
+                completed=offset,
+            )
+            progress.start_task(self._task_id)
+            with open(self.partial, "ab" if offset else "wb") as f:
+                for chunk in stream_iterator(response):
+                    f.write(chunk)
+                    progress.update(self._task_id, advance=len(chunk))
+            if length is not None and self.partial.stat().st_size < offset + int(
+                length
+            ):
+                raise http.client.IncompleteRead(b"")
+
+    def fetch(self) -> Path:
+        """Downloads the file (if necessary), verifies it, and returns its path"""
+        expected = self._progress.sha256
+        if self.destination.exists():
+            if expected is not None and file_sha256(self.destination) == expected:
+                _logger.debug(f"Using the previously downloaded {self.destination!s}")
+                return self.destination
+            self.destination.unlink()
+        retries = self._progress.retries
+        for attempt in range(retries + 1):
+            try:
+                self._fetch_once()
+            except HTTPError as e:
+                if e.code == 416:
+                    # the range we requested is not satisfiable, so start over
+                    self._discard_partial()
+                elif e.code < 500 and e.code not in (408, 429):
+                    raise
+                if attempt == retries:
+                    raise
+                error: Exception = e
+            except (URLError, OSError, http.client.HTTPException) as e:
+                if attempt == retries:
+                    raise
+                error = e
+            else:
+                if expected is None or file_sha256(self.partial) == expected:
+                    self.partial.replace(self.destination)
+                    self.validators.unlink()
+                    return self.destination
+                self._discard_partial()
+                error = DownloadVerificationError(
+                    f"The SHA256 digest of {self._progress.url} does not match {expected}"
+                )
+                if attempt == retries:
+                    raise error
+            delay = min(2**attempt, 60)
+            _logger.warning(
+                f"Error downloading {self._progress.filename} ({error!s}); retrying in "
+                f"{delay} second(s)…"
+            )
+            time.sleep(delay)
+        raise AssertionError("unreachable")
 
 
 class DownloadWithProgress:
@@ -67,7 +183,19 @@ class DownloadWithProgress:
         url: str,
         console: Optional[Console] = None,
         progress: Optional[Progress] = None,
+        filename: Optional[str] = None,
+        destination: Optional[Path] = None,
+        sha256: Optional[str] = None,
+        retries: int = 5,
     ):
+        """
+        Downloads `url` to `destination` when entered, returning the open, verified file.
+
+        If `destination` is None, the file is downloaded to a temporary directory.
+        If `sha256` is not None, the download is verified against it.
+        When the context exits without an exception, the downloaded file is deleted;
+        otherwise it is kept so that the next attempt does not have to download it again.
+        """
         self.url: str = url
         if console is None:
             if progress is not None:
@@ -92,21 +220,44 @@ class DownloadWithProgress:
         else:
             self._enter_progress = False
         self.progress: Progress = progress
-        self.filename: str = Path(urlparse(self.url).path).name
+        if filename is None:
+            filename = Path(urlparse(self.url).path).name
+        self.filename: str = filename
+        self.sha256: Optional[str] = sha256
+        self.retries: int = retries
+        self._tmpdir: Optional[TemporaryDirectory] = None
+        if destination is None:
+            self._tmpdir = TemporaryDirectory(prefix="deptective-download-")
+            destination = Path(self._tmpdir.name) / Path(urlparse(self.url).path).name
+        self.destination: Path = destination
+        self._file: Optional[BinaryIO] = None
 
-    def __enter__(self) -> Download:
+    def __enter__(self) -> BinaryIO:
         if self._enter_progress:
             self.progress.start()
         try:
-            return Download(self)
+            self.destination.parent.mkdir(parents=True, exist_ok=True)
+            path = Download(self, self.destination).fetch()
+            self._file = open(path, "rb")
         except:
-            self.progress.stop()
+            if self._enter_progress:
+                self.progress.stop()
+            if self._tmpdir is not None:
+                self._tmpdir.cleanup()
             raise
+        self.progress.console.log(f"Downloaded {self.filename}")
+        return self._file
 
     def __exit__(self, exc_type, exc_val, exc_tb):
         if self._enter_progress:
             self.progress.stop()
-        self.progress.console.log(f"Downloaded {self.filename}")
+        if self._file is not None:
+            self._file.close()
+            self._file = None
+        if exc_type is None and self.destination.exists():
+            self.destination.unlink()
+        if self._tmpdir is not None:
+            self._tmpdir.cleanup()
 
 
 def stream_iterator(stream: BinaryIO, chunk_size: int = 32768) -> Iterator[bytes]:
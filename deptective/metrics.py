@@ -0,0 +1,281 @@
+import json
+import threading
+from pathlib import Path
+from typing import Any, Dict, Iterable, List, Optional, Sequence, Tuple, Union
+
+LabelValues = Tuple[str, ...]
+
+DEFAULT_BUCKETS: Tuple[float, ...] = (
+    0.1,
+    0.5,
+    1.0,
+    2.5,
+    5.0,
+    10.0,
+    30.0,
+    60.0,
+    120.0,
+    300.0,
+    600.0,
+)
+
+
+def _escape(value: str) -> str:
+    return value.replace("\\", "\\\\").replace("\n", "\\n").replace('"', '\\"')
+
+
+def _format_labels(names: Sequence[str], values: Sequence[str]) -> str:
+    if not names:
+        return ""
+    labels = ",".join(f'{n}="{_escape(v)}"' for n, v in zip(names, values))
+    return f"{{{labels}}}"
+
+
+def _format_number(value: float) -> str:
+    if value == float("inf"):
+        return "+Inf"
+    elif float(value).is_integer():
+        return str(int(value))
+    return repr(float(value))
+
+
+class Metric:
+    TYPE: str
+
+    def __init__(self, name: str, documentation: str, labelnames: Iterable[str] = ()):
+        self.name: str = name
+        self.documentation: str = documentation
+        self.labelnames: Tuple[str, ...] = tuple(labelnames)
+        self._lock = threading.Lock()
+
+    def _label_values(self, labels: Dict[str, Any]) -> LabelValues:
+        if set(labels) != set(self.labelnames):
+            raise ValueError(
+                f"{self.name} expects labels {self.labelnames!r} but got {tuple(labels)!r}"
+            )
+        return tuple(str(labels[n]) for n in self.labelnames)
+
+    def prometheus_lines(self) -> Iterable[str]:
+        raise NotImplementedError()
+
+    def to_json(self) -> List[Dict[str, Any]]:
+        raise NotImplementedError()
+
+
+class Counter(Metric):
+    TYPE = "counter"
+
+    def __init__(self, name: str, documentation: str, labelnames: Iterable[str] = ()):
+        super().__init__(name, documentation, labelnames)
+        self._values: Dict[LabelValues, float] = {}
+
+    def inc(self, amount: float = 1, **labels: Any):
+        key = self._label_values(labels)
+        with self._lock:
+            self._values[key] = self._values.get(key, 0) + amount
+
+    def value(self, **labels: Any) -> float:
+        with self._lock:
+            return self._values.get(self._label_values(labels), 0)
+
+    def prometheus_lines(self) -> Iterable[str]:
+        with self._lock:
+            values = dict(self._values)
+        for key, value in sorted(values.items()):
+            yield f"{self.name}{_format_labels(self.labelnames, key)} {_format_number(value)}"
+
+    def to_json(self) -> List[Dict[str, Any]]:
+        with self._lock:
+            return [
+                {"labels": dict(zip(self.labelnames, key)), "value": value}
+                for key, value in sorted(self._values.items())
+            ]
+
+
+class Histogram(Metric):
+    TYPE = "histogram"
+
+    def __init__(
+        self,
+        name: str,
+        documentation: str,
+        labelnames: Iterable[str] = (),
+        buckets: Sequence[float] = DEFAULT_BUCKETS,
+    ):
+        super().__init__(name, documentation, labelnames)
+        self.buckets: Tuple[float, ...] = tuple(sorted(buckets)) + (float("inf"),)
+        self._counts: Dict[LabelValues, List[int]] = {}
+        self._sums: Dict[LabelValues, float] = {}
+
+    def observe(self, value: float, **labels: Any):
+        key = self._label_values(labels)
+        with self._lock:
+            if key not in self._counts:
+                self._counts[key] = [0] * len(self.buckets)
+                self._sums[key] = 0.0
+            counts = self._counts[key]
+            for i, bound in enumerate(self.buckets):
+                if value <= bound:
+                    counts[i] += 1
+            self._sums[key] += value
+
+    def count(self, **labels: Any) -> int:
+        with self._lock:
+            counts = self._counts.get(self._label_values(labels))
+            return 0 if counts is None else counts[-1]
+
+    def prometheus_lines(self) -> Iterable[str]:
+        with self._lock:
+            counts = {key: list(c) for key, c in self._counts.items()}
+            sums = dict(self._sums)
+        for key in sorted(counts):
+            for bound, count in zip(self.buckets, counts[key]):
+                labels = _format_labels(
+                    self.labelnames + ("le",), key + (_format_number(bound),)
+                )
+                yield f"{self.name}_bucket{labels} {count}"
+            labels = _format_labels(self.labelnames, key)
+            yield f"{self.name}_sum{labels} {_format_number(sums[key])}"
+            yield f"{self.name}_count{labels} {counts[key][-1]}"
+
+    def to_json(self) -> List[Dict[str, Any]]:
+        with self._lock:
+            return [
+                {
+                    "labels": dict(zip(self.labelnames, key)),
+                    "count": counts[-1],
+                    "sum": self._sums[key],
+                    "buckets": {
+                        _format_number(bound): count
+                        for bound, count in zip(self.buckets, counts)
+                    },
+                }
+                for key, counts in sorted(self._counts.items())
+            ]
+
+
+class MetricsRegistry:
+    def __init__(self):
+        self.metrics: Dict[str, Metric] = {}
+        self._lock = threading.Lock()
+        # metrics that cost extra Docker requests are only collected once this is set
+        self.exporting: bool = False
+
+    def _register(self, metric: Metric) -> Any:
+        with self._lock:
+            existing = self.metrics.get(metric.name)
+            if existing is not None:
+                if type(existing) is not type(metric):
+                    raise ValueError(f"{metric.name} is already registered")
+                return existing
+            self.metrics[metric.name] = metric
+            return metric
+
+    def counter(
+        self, name: str, documentation: str, labelnames: Iterable[str] = ()
+    ) -> Counter:
+        return self._register(Counter(name, documentation, labelnames))
+
+    def histogram(
+        self,
+        name: str,
+        documentation: str,
+        labelnames: Iterable[str] = (),
+        buckets: Sequence[float] = DEFAULT_BUCKETS,
+    ) -> Histogram:
+        return self._register(Histogram(name, documentation, labelnames, buckets))
+
+    def to_prometheus(self) -> str:
+        lines: List[str] = []
+        for name in sorted(self.metrics):
+            metric = self.metrics[name]
+            lines.append(f"# HELP {name} {_escape(metric.documentation)}")
+            lines.append(f"# TYPE {name} {metric.TYPE}")
+            lines.extend(metric.prometheus_lines())
+        return "\n".join(lines) + "\n"
+
+    def to_json(self) -> Dict[str, Any]:
+        return {
+            name: {
+                "type": metric.TYPE,
+                "help": metric.documentation,
+                "values": metric.to_json(),
+            }
+            for name, metric in sorted(self.metrics.items())
+        }
+
+    def write(self, path: Union[str, Path], format: Optional[str] = None):
+        """Writes the metrics to `path` in either the Prometheus text format or JSON.
+        If `format` is None, JSON is used if `path` ends in `.json`."""
+        path = Path(path)
+        if format is None:
+            format = "json" if path.suffix.lower() == ".json" else "prometheus"
+        with open(path, "w") as f:
+            if format == "json":
+                json.dump(self.to_json(), f, indent=2)
+            elif format == "prometheus":
+                f.write(self.to_prometheus())
+            else:
+                raise ValueError(f"Unsupported metrics format {format!r}")
+
+
+METRICS = MetricsRegistry()
+
+CONTAINERS_CREATED = METRICS.counter(
+    "deptective_containers_created_total", "Docker containers created"
+)
+IMAGES_COMMITTED = METRICS.counter(
+    "deptective_images_committed_total", "Docker images committed for resolution steps"
+)
+IMAGE_BYTES_COMMITTED = METRICS.counter(
+    "deptective_image_bytes_committed_total",
+    "Bytes written to the top layer of committed step images (only collected when the "
+    "metrics are exported)",
+)
+PACKAGE_INSTALLS = METRICS.counter(
+    "deptective_package_installs_total",
+    "Package installs attempted, by result",
+    ("result",),
+)
+TRACE_LINES_PARSED = METRICS.counter(
+    "deptective_trace_lines_parsed_total", "Lines of strace output parsed"
+)
+CACHE_LOOKUPS = METRICS.counter(
+    "deptective_cache_lookups_total", "Package cache lookups of a path"
+)
+CACHE_HITS = METRICS.counter(
+    "deptective_cache_hits_total",
+    "Package cache lookups that found at least one providing package; the hit rate is "
+    "this divided by deptective_cache_lookups_total",
+)
+CACHE_FILTERED = METRICS.counter(
+    "deptective_cache_filtered_total",
+    "Package cache lookups that the Bloom filter of packaged paths answered without "
+    "querying the database",
+)
+NODES_PRUNED = METRICS.counter(
+    "deptective_nodes_pruned_total",
+    "Search nodes that were skipped, by the rule that pruned them",
+    ("rule",),
+)
+STEP_DURATION = METRICS.histogram(
+    "deptective_step_duration_seconds",
+    "Time to run and analyze the traced command for a single resolution step",
+)
+CONTAINER_QUEUE_DELAY = METRICS.histogram(
+    "deptective_container_queue_delay_seconds",
+    "Time that containers waited for a scheduler slot before starting",
+)
+CONTAINER_THROTTLED = METRICS.counter(
+    "deptective_container_throttled_seconds_total",
+    "Time that scheduled containers were throttled by their CPU quota",
+)
+CONTAINER_OOM_KILLS = METRICS.counter(
+    "deptective_container_oom_kills_total",
+    "Scheduled containers whose processes were killed for exceeding the memory limit",
+)
+REMOTE_REQUESTS = METRICS.counter(
+    "deptective_remote_requests_total",
+    "Requests to a remote cache, by operation and HTTP status",
+    ("operation", "result"),
+)
@@ -1,3 +1,4 @@
+import hashlib
 import platform
 import re
 import sys
@@ -5,13 +6,40 @@ from abc import ABC, abstractmethod
 from dataclasses import dataclass
 from inspect import isabstract
 from pathlib import Path
-from typing import Dict, FrozenSet, Iterator, Optional, Tuple, Type, TypeVar
+from typing import Dict, FrozenSet, Iterable, Iterator, Optional, Tuple, Type, TypeVar
+
+from rich.progress import Progress
 
 from .containers import DockerContainer
 
 T = TypeVar("T")
 
 
+def sources_digest(*sources: str) -> str:
+    return hashlib.sha256("\n".join(sources).encode("utf-8")).hexdigest()[:12]
+
+
+# the top-level directories that are symlinks into /usr on merged-/usr systems
+MERGED_USR_DIRECTORIES: Tuple[str, ...] = (
+    "bin",
+    "sbin",
+    "lib",
+    "lib32",
+    "lib64",
+    "libx32",
+)
+
+
+def merged_usr_path(path: str) -> str:
+    """Returns the path under /usr to which `path` refers on a merged-/usr system, so that
+    paths recorded by package managers (e.g., `/bin/ls`) can be compared with paths
+    accessed at runtime (e.g., `/usr/bin/ls`)"""
+    top, _, rest = path.lstrip("/").partition("/")
+    if top in MERGED_USR_DIRECTORIES:
+        return f"/usr/{top}/{rest}" if rest else f"/usr/{top}"
+    return path
+
+
 @dataclass(eq=True, frozen=True, unsafe_hash=True)
 class PackagingConfig:
     os: str
@@ -101,11 +129,48 @@ class PackageManager(ABC):
         raise NotImplementedError()
 
     @abstractmethod
-    def install(self, container: DockerContainer, *packages: str) -> Tuple[int, bytes]:
+    def install_command(self, packages: Iterable[str]) -> str:
+        """The shell command that installs `packages`"""
         raise NotImplementedError()
 
+    def install(self, container: DockerContainer, *packages: str) -> Tuple[int, bytes]:
+        if not packages:
+            return 0, b""
+        return container.exec_run(self.install_command(packages))
+
+    def installed_packages(
+        self, container: DockerContainer
+    ) -> Optional[FrozenSet[str]]:
+        """Returns the names of the packages installed in `container`, or None if this
+        package manager cannot list them"""
+        return None
+
+    def package_files(
+        self, container: DockerContainer, packages: Iterable[str]
+    ) -> Optional[FrozenSet[str]]:
+        """Returns the paths that `packages` installed in `container`, including
+        directories, or None if this package manager cannot list them"""
+        return None
+
+    def sources_id(self) -> Optional[str]:
+        """A short digest of the mirror and sources that packages come from, or None if
+        they are the defaults"""
+        return None
+
+    def with_sources_id(self, name: str) -> str:
+        """Appends the sources ID, if any, to `name`, so that files derived from other
+        sources, such as package databases, are kept apart"""
+        sources_id = self.sources_id()
+        if sources_id is None:
+            return name
+        return f"{name}_{sources_id}"
+
     @abstractmethod
-    def iter_packages(self) -> Iterator[Tuple[str, FrozenSet[str]]]:
+    def iter_packages(
+        self, progress: Optional[Progress] = None
+    ) -> Iterator[Tuple[str, FrozenSet[str]]]:
+        """Yields every path in the package database along with the packages that provide it.
+        If `progress` is not None, any download progress is reported to it."""
         raise NotImplementedError()
 
     @classmethod
@@ -0,0 +1,120 @@
+import json
+import os
+import threading
+import time
+from contextlib import contextmanager
+from pathlib import Path
+from typing import Any, Dict, Iterator, List, Union
+
+
+class Profiler:
+    """Records timed spans in the Chrome trace-event format.
+
+    The output of `write` can be opened in Perfetto (https://ui.perfetto.dev) or in
+    `chrome://tracing`. Spans are only recorded once the profiler is enabled, so
+    instrumentation is essentially free otherwise.
+
+    """
+
+    def __init__(self):
+        self.enabled: bool = False
+        self.events: List[Dict[str, Any]] = []
+        self._thread_names: Dict[int, str] = {}
+        self._lock = threading.Lock()
+        self._origin: float = time.perf_counter()
+
+    def enable(self):
+        self.enabled = True
+
+    def _timestamp(self, t: float) -> float:
+        # trace-event timestamps are in microseconds
+        return (t - self._origin) * 1_000_000
+
+    def _record(self, event: Dict[str, Any]):
+        thread = threading.current_thread()
+        event["pid"] = os.getpid()
+        event["tid"] = thread.ident
+        with self._lock:
+            self._thread_names.setdefault(thread.ident, thread.name)  # type: ignore
+            self.events.append(event)
+
+    @contextmanager
+    def span(
+        self, name: str, category: str = "deptective", **args: Any
+    ) -> Iterator[Dict[str, Any]]:
+        """Times the enclosed block. The yielded dict can be used to add attributes."""
+        if not self.enabled:
+            yield args
+            return
+        start = time.perf_counter()
+        try:
+            yield args
+        except BaseException as e:
+            args["error"] = f"{e.__class__.__name__}: {e!s}"
+            raise
+        finally:
+            end = time.perf_counter()
+            self._record(
+                {
+                    "name": name,
+                    "cat": category,
+                    "ph": "X",
+                    "ts": self._timestamp(start),
+                    "dur": (end - start) * 1_000_000,
+                    "args": args,
+                }
+            )
+
+    def instant(self, name: str, category: str = "deptective", **args: Any):
+        """Marks a point in time, such as a decision, rather than a timed block"""
+        if self.enabled:
+            self._record(
+                {
+                    "name": name,
+                    "cat": category,
+                    "ph": "i",
+                    "s": "t",
+                    "ts": self._timestamp(time.perf_counter()),
+                    "args": args,
+                }
+            )
+
+    def to_json(self) -> Dict[str, Any]:
+        with self._lock:
+            events = list(self.events)
+            thread_names = dict(self._thread_names)
+        pid = os.getpid()
+        metadata: List[Dict[str, Any]] = [
+            {
+                "name": "process_name",
+                "ph": "M",
+                "pid": pid,
+                "args": {"name": "deptective"},
+            }
+        ]
+        metadata.extend(
+            {
+                "name": "thread_name",
+                "ph": "M",
+                "pid": pid,
+                "tid": tid,
+                "args": {"name": name},
+            }
+            for tid, name in thread_names.items()
+        )
+        return {"traceEvents": metadata + events, "displayTimeUnit": "ms"}
+
+    def write(self, path: Union[str, Path]):
+        with open(path, "w") as f:
+            json.dump(self.to_json(), f, default=str)
+
+
+PROFILER = Profiler()
+
+
+def span(name: str, category: str = "deptective", **args: Any):
+    return PROFILER.span(name, category, **args)
+
+
+def instant(name: str, category: str = "deptective", **args: Any):
+    PROFILER.instant(name, category, **args)
@@ -0,0 +1,175 @@
+import logging
+import sys
+from concurrent.futures import ThreadPoolExecutor
+from typing import Callable, Dict, Iterator, List, Mapping, Optional, Set
+
+from rich.console import Console
+from rich.progress import Progress, SpinnerColumn, TaskID, TextColumn
+from rich.table import Table
+
+from .cache import Cache
+from .dependencies import SBOM, Resolution, SBOMGenerator
+
+logger = logging.getLogger(__name__)
+
+
+class ReleaseResolution:
+    def __init__(self, release: str):
+        self.release: str = release
+        self.results: List[Resolution] = []
+        self.error: Optional[Exception] = None
+
+    @property
+    def sboms(self) -> List[SBOM]:
+        return [result.sbom for result in self.results]
+
+    @property
+    def succeeded(self) -> bool:
+        return self.error is None and bool(self.sboms)
+
+
+class MultiReleaseResolver:
+    """Resolves the same command(s) against several releases concurrently.
+
+    Each release gets its own generator (and therefore its own cache and base image).
+    Every package that appears in a result for one release is added to a hint set that
+    is shared by all of the generators, so the remaining releases try those packages
+    first. Since the releases run concurrently, this rarely helps in practice: a hint
+    only takes effect if it is added before another release chooses a provider for the
+    same file, which usually means that release is resolving more than one result.
+
+    `generator_class` is called with each release's cache in place of `SBOMGenerator`,
+    e.g., to resolve against a `PackageUniverse` with a `SimulatedSBOMGenerator`.
+
+    """
+
+    def __init__(
+        self,
+        caches: Mapping[str, Cache],
+        console: Optional[Console] = None,
+        generator_class: Callable[..., SBOMGenerator] = SBOMGenerator,
+    ):
+        if console is None:
+            console = Console(log_path=False, file=sys.stderr)
+        self.console: Console = console
+        self.hints: Set[str] = set()
+        self.generators: Dict[str, SBOMGenerator] = {
+            release: generator_class(
+                cache, console=console, interactive=False, hints=self.hints
+            )
+            for release, cache in caches.items()
+        }
+
+    def resolve(
+        self,
+        results_for: Callable[[SBOMGenerator], Iterator[Resolution]],
+        num_results: int = 1,
+        on_result: Optional[Callable[[str, Resolution], None]] = None,
+    ) -> Dict[str, ReleaseResolution]:
+        """Runs `results_for(generator)` for every release and collects up to
+        `num_results` results from each (all results if `num_results` is zero).
+        If provided, `on_result(release, result)` is called as soon as each result is
+        found."""
+        results = {release: ReleaseResolution(release) for release in self.generators}
+        with Progress(
+            SpinnerColumn(),
+            TextColumn("[bold blue]{task.fields[release]}"),
+            TextColumn("{task.description}"),
+            console=self.console,
+            transient=True,
+        ) as progress:
+            tasks: Dict[str, TaskID] = {
+                release: progress.add_task("resolving…", release=release, total=None)
+                for release in self.generators
+            }
+
+            def run(release: str):
+                generator = self.generators[release]
+                resolution = results[release]
+                result_iter: Optional[Iterator[Resolution]] = None
+                try:
+                    result_iter = results_for(generator)
+                    for result in result_iter:
+                        resolution.results.append(result)
+                        self.hints.update(result.sbom)
+                        if on_result is not None:
+                            on_result(release, result)
+                        progress.update(
+                            tasks[release],
+                            description=f"{len(resolution.results)} result(s) found…",
+                        )
+                        if 0 < num_results <= len(resolution.results):
+                            break
+                except Exception as e:
+                    resolution.error = e
+                    logger.error(f"{release}: {e!s}")
+                finally:
+                    # tear down any steps that are still open if we stopped early
+                    close = getattr(result_iter, "close", None)
+                    if close is not None:
+                        close()
+                    if resolution.error is not None:
+                        status = "[red]failed"
+                    else:
+                        status = f"[green]done ({len(resolution.results)} result(s))"
+                    progress.update(tasks[release], description=status, total=1)
+
+            with ThreadPoolExecutor(
+                max_workers=len(self.generators),
+                thread_name_prefix="deptective-release",
+            ) as pool:
+                futures = [pool.submit(run, release) for release in self.generators]
+                try:
+                    for future in futures:
+                        future.result()
+                except KeyboardInterrupt:
+                    for generator in self.generators.values():
+                        generator.cancel()
+                    raise
+        return results
+
+
+def release_report(results: Dict[str, ReleaseResolution]) -> Table:
+    """Tabulates the first result for every release, highlighting the packages that are
+    not required by all of them"""
+    releases = list(results.keys())
+    firsts: Dict[str, Set[str]] = {
+        release: set(resolution.sboms[0]) if resolution.sboms else set()
+        for release, resolution in results.items()
+    }
+    all_packages = sorted(set().union(*firsts.values()))
+    succeeded = [firsts[r] for r in releases if results[r].succeeded]
+    common: Set[str] = set.intersection(*succeeded) if succeeded else set()
+
+    table = Table(title="Dependencies by Release")
+    table.add_column("Package", justify="left", style="bold", no_wrap=True)
+    for release in releases:
+        table.add_column(release, justify="center")
+
+    for package in all_packages:
+        if package in common:
+            name = package
+        else:
+            name = f"[yellow]{package}[/yellow]"
+        table.add_row(
+            name,
+            *(
+                ":heavy_check_mark:" if package in firsts[release] else ""
+                for release in releases
+            ),
+        )
+
+    statuses = []
+    for release in releases:
+        resolution = results[release]
+        if resolution.error is not None:
+            statuses.append("[red]error")
+        elif not resolution.sboms:
+            statuses.append("[red]no result")
+        elif not resolution.sboms[0]:
+            statuses.append("[green]none needed")
+        else:
+            statuses.append("[green]ok")
+    table.add_section()
+    table.add_row("[italic]status", *statuses)
+    return table
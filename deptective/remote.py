@@ -0,0 +1,705 @@
+"""A content-addressed store that lets several machines share package databases,
+infeasible package sequences, and results.
+
+Blobs are addressed by the SHA-256 of their contents and are immutable; refs are mutable
+names that point to a blob. The same store can live in a local directory or be reached
+over HTTP, and `RemoteCacheServer` serves a directory store over HTTP:
+
+    GET  /blobs/<sha256>   the blob (404 if missing)
+    HEAD /blobs/<sha256>   whether the blob exists
+    PUT  /blobs/<sha256>   uploads a blob, which is rejected unless its digest matches
+    GET  /refs/<name>      the digest to which `name` points (404 if unset)
+    PUT  /refs/<name>      points `name` to the digest in the request body; with an
+                           `If-Match: <digest>` or `If-None-Match: *` header, only if
+                           `name` currently points to that digest or is unset (412
+                           otherwise)
+    GET  /metrics          the server's metrics in the Prometheus text format
+
+"""
+
+import fcntl
+import gzip
+import hashlib
+import json
+import os
+import re
+import shutil
+import threading
+from abc import ABC, abstractmethod
+from contextlib import contextmanager
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from logging import getLogger
+from pathlib import Path
+from tempfile import NamedTemporaryFile, TemporaryFile
+from typing import (
+    IO,
+    Any,
+    Callable,
+    Dict,
+    Iterable,
+    Iterator,
+    List,
+    Optional,
+    Sequence,
+    Tuple,
+)
+from urllib.error import HTTPError, URLError
+from urllib.parse import urlparse
+from urllib.request import Request, urlopen
+
+from .cache import Cache, SQLCache
+from .dependencies import SBOM, Decision, Resolution, SBOMGenerator
+from .metrics import METRICS, REMOTE_REQUESTS
+from .package_manager import PackageManager
+
+logger = getLogger(__name__)
+
+DIGEST_PATTERN = re.compile(r"[0-9a-f]{64}")
+REF_PATTERN = re.compile(r"[A-Za-z0-9._-]+(/[A-Za-z0-9._-]+)*")
+CHUNK_SIZE = 1024 * 1024
+# how many times a ref is re-read and merged when another client updated it concurrently
+MERGE_ATTEMPTS = 10
+
+
+class RemoteStoreError(RuntimeError):
+    pass
+
+
+def _check_digest(digest: str):
+    if not DIGEST_PATTERN.fullmatch(digest):
+        raise ValueError(f"Invalid digest {digest!r}")
+
+
+def _check_ref(name: str):
+    if not REF_PATTERN.fullmatch(name) or ".." in name.split("/"):
+        raise ValueError(f"Invalid ref name {name!r}")
+
+
+def _copy_hashing(src: IO[bytes], dst: IO[bytes]) -> str:
+    h = hashlib.sha256()
+    for chunk in iter(lambda: src.read(CHUNK_SIZE), b""):
+        h.update(chunk)
+        dst.write(chunk)
+    return h.hexdigest()
+
+
+def file_digest(f: IO[bytes]) -> str:
+    """Returns the SHA-256 of the rest of `f`, and then rewinds it to where it was"""
+    start = f.tell()
+    h = hashlib.sha256()
+    for chunk in iter(lambda: f.read(CHUNK_SIZE), b""):
+        h.update(chunk)
+    f.seek(start)
+    return h.hexdigest()
+
+
+class BlobStore(ABC):
+    @abstractmethod
+    def has(self, digest: str) -> bool:
+        raise NotImplementedError()
+
+    @abstractmethod
+    def get(self, digest: str, out: IO[bytes]) -> bool:
+        """Writes the blob to `out`, returning False if it does not exist"""
+        raise NotImplementedError()
+
+    @abstractmethod
+    def put(self, data: IO[bytes], digest: Optional[str] = None) -> str:
+        """Stores the rest of the seekable stream `data` and returns its digest. If
+        `digest` is provided, the blob is rejected unless its contents match it."""
+        raise NotImplementedError()
+
+    @abstractmethod
+    def get_ref(self, name: str) -> Optional[str]:
+        raise NotImplementedError()
+
+    @abstractmethod
+    def set_ref(self, name: str, digest: str):
+        raise NotImplementedError()
+
+    @abstractmethod
+    def compare_and_set_ref(
+        self, name: str, expected: Optional[str], digest: str
+    ) -> bool:
+        """Points `name` to `digest` only if it currently points to `expected` (or is
+        unset, if `expected` is None), returning whether it was updated"""
+        raise NotImplementedError()
+
+    def get_bytes(self, digest: str) -> Optional[bytes]:
+        with TemporaryFile() as f:
+            if not self.get(digest, f):
+                return None
+            f.seek(0)
+            return f.read()
+
+    def put_bytes(self, data: bytes) -> str:
+        with TemporaryFile() as f:
+            f.write(data)
+            f.seek(0)
+            return self.put(f)
+
+    def get_json(self, name: str) -> Any:
+        """Returns the JSON document that the ref `name` points to, or None"""
+        digest = self.get_ref(name)
+        if digest is None:
+            return None
+        data = self.get_bytes(digest)
+        if data is None:
+            return None
+        return json.loads(data)
+
+    def set_json(self, name: str, value: Any):
+        digest = self.put_bytes(json.dumps(value, sort_keys=True).encode("utf-8"))
+        self.set_ref(name, digest)
+
+
+class DirectoryStore(BlobStore):
+    def __init__(self, root: Path):
+        self.root: Path = root
+        self.blobs: Path = root / "blobs"
+        self.refs: Path = root / "refs"
+        self.tmp: Path = root / "tmp"
+        for directory in (self.blobs, self.refs, self.tmp):
+            directory.mkdir(parents=True, exist_ok=True)
+
+    def blob_path(self, digest: str) -> Path:
+        _check_digest(digest)
+        return self.blobs / digest[:2] / digest
+
+    def has(self, digest: str) -> bool:
+        return self.blob_path(digest).exists()
+
+    def get(self, digest: str, out: IO[bytes]) -> bool:
+        path = self.blob_path(digest)
+        try:
+            with open(path, "rb") as f:
+                shutil.copyfileobj(f, out, CHUNK_SIZE)
+        except FileNotFoundError:
+            return False
+        return True
+
+    def put(self, data: IO[bytes], digest: Optional[str] = None) -> str:
+        with NamedTemporaryFile(dir=self.tmp, delete=False) as tmp:
+            try:
+                actual = _copy_hashing(data, tmp)
+                if digest is not None and actual != digest:
+                    raise ValueError(
+                        f"The blob's digest is {actual}, but {digest} was expected"
+                    )
+                path = self.blob_path(actual)
+                path.parent.mkdir(exist_ok=True)
+                tmp.close()
+                os.replace(tmp.name, path)
+            finally:
+                if os.path.exists(tmp.name):
+                    os.unlink(tmp.name)
+        return actual
+
+    def get_ref(self, name: str) -> Optional[str]:
+        _check_ref(name)
+        try:
+            return (self.refs / name).read_text().strip()
+        except FileNotFoundError:
+            return None
+
+    @contextmanager
+    def _refs_locked(self) -> Iterator[None]:
+        # an flock, so that it also excludes other processes and other server threads
+        with open(self.root / "refs.lock", "a") as lock:
+            fcntl.flock(lock, fcntl.LOCK_EX)
+            try:
+                yield
+            finally:
+                fcntl.flock(lock, fcntl.LOCK_UN)
+
+    def _write_ref(self, name: str, digest: str):
+        if not self.has(digest):
+            raise ValueError(f"Blob {digest} does not exist")
+        path = self.refs / name
+        path.parent.mkdir(parents=True, exist_ok=True)
+        with NamedTemporaryFile("w", dir=self.tmp, delete=False) as tmp:
+            tmp.write(digest)
+        os.replace(tmp.name, path)
+
+    def set_ref(self, name: str, digest: str):
+        _check_ref(name)
+        with self._refs_locked():
+            self._write_ref(name, digest)
+
+    def compare_and_set_ref(
+        self, name: str, expected: Optional[str], digest: str
+    ) -> bool:
+        _check_ref(name)
+        with self._refs_locked():
+            if self.get_ref(name) != expected:
+                return False
+            self._write_ref(name, digest)
+        return True
+
+
+class HTTPStore(BlobStore):
+    def __init__(self, url: str, timeout: float = 60):
+        self.url: str = url.rstrip("/")
+        self.timeout: float = timeout
+
+    def _request(
+        self,
+        operation: str,
+        method: str,
+        path: str,
+        data: Optional[Any] = None,
+        headers: Optional[Dict[str, str]] = None,
+    ):
+        request = Request(
+            f"{self.url}/{path}", data=data, method=method, headers=headers or {}
+        )
+        try:
+            response = urlopen(request, timeout=self.timeout)
+        except HTTPError as e:
+            REMOTE_REQUESTS.inc(operation=operation, result=str(e.code))
+            raise
+        except URLError:
+            REMOTE_REQUESTS.inc(operation=operation, result="error")
+            raise
+        REMOTE_REQUESTS.inc(operation=operation, result=str(response.status))
+        return response
+
+    def has(self, digest: str) -> bool:
+        _check_digest(digest)
+        try:
+            self._request("has", "HEAD", f"blobs/{digest}").close()
+        except HTTPError as e:
+            if e.code == 404:
+                return False
+            raise
+        return True
+
+    def get(self, digest: str, out: IO[bytes]) -> bool:
+        _check_digest(digest)
+        try:
+            response = self._request("get", "GET", f"blobs/{digest}")
+        except HTTPError as e:
+            if e.code == 404:
+                return False
+            raise
+        with response:
+            actual = _copy_hashing(response, out)
+        if actual != digest:
+            raise RemoteStoreError(
+                f"{self.url} returned a blob with digest {actual} instead of {digest}"
+            )
+        return True
+
+    def put(self, data: IO[bytes], digest: Optional[str] = None) -> str:
+        actual = file_digest(data)
+        if digest is not None and actual != digest:
+            raise ValueError(
+                f"The blob's digest is {actual}, but {digest} was expected"
+            )
+        if self.has(actual):
+            return actual
+        start = data.tell()
+        data.seek(0, os.SEEK_END)
+        size = data.tell() - start
+        data.seek(start)
+        self._request(
+            "put",
+            "PUT",
+            f"blobs/{actual}",
+            data=data,
+            headers={
+                "Content-Length": str(size),
+                "Content-Type": "application/octet-stream",
+            },
+        ).close()
+        return actual
+
+    def get_ref(self, name: str) -> Optional[str]:
+        _check_ref(name)
+        try:
+            with self._request("get_ref", "GET", f"refs/{name}") as response:
+                return response.read().decode("utf-8").strip()
+        except HTTPError as e:
+            if e.code == 404:
+                return None
+            raise
+
+    def set_ref(self, name: str, digest: str):
+        _check_ref(name)
+        _check_digest(digest)
+        self._request(
+            "set_ref", "PUT", f"refs/{name}", data=digest.encode("utf-8")
+        ).close()
+
+    def compare_and_set_ref(
+        self, name: str, expected: Optional[str], digest: str
+    ) -> bool:
+        _check_ref(name)
+        _check_digest(digest)
+        if expected is None:
+            headers = {"If-None-Match": "*"}
+        else:
+            _check_digest(expected)
+            headers = {"If-Match": f'"{expected}"'}
+        try:
+            self._request(
+                "set_ref",
+                "PUT",
+                f"refs/{name}",
+                data=digest.encode("utf-8"),
+                headers=headers,
+            ).close()
+        except HTTPError as e:
+            if e.code == 412:
+                return False
+            raise
+        return True
+
+
+def open_store(url: str) -> BlobStore:
+    """Opens the store at `url`, which is either an HTTP(S) URL or a local directory"""
+    parsed = urlparse(url)
+    if parsed.scheme in ("http", "https"):
+        return HTTPStore(url)
+    elif parsed.scheme == "file":
+        return DirectoryStore(Path(parsed.path))
+    elif parsed.scheme:
+        raise ValueError(f"Unsupported remote store {url!r}")
+    return DirectoryStore(Path(url))
+
+
+class _StoreRequestHandler(BaseHTTPRequestHandler):
+    server: "_StoreHTTPServer"
+
+    def log_message(self, format, *args):
+        logger.debug(f"{self.address_string()} {format % args}")
+
+    def _reply(self, code: int, body: bytes = b"", content_type: str = "text/plain"):
+        self.send_response(code)
+        self.send_header("Content-Type", content_type)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        if body and self.command != "HEAD":
+            self.wfile.write(body)
+
+    def _route(self) -> Tuple[str, str]:
+        kind, _, name = self.path.lstrip("/").partition("/")
+        return kind, name
+
+    def _serve_get(self):
+        store = self.server.store
+        kind, name = self._route()
+        try:
+            if kind == "blobs":
+                path = store.blob_path(name)
+                if not path.exists():
+                    self._reply(404)
+                    return
+                self.send_response(200)
+                self.send_header("Content-Type", "application/octet-stream")
+                self.send_header("Content-Length", str(path.stat().st_size))
+                self.end_headers()
+                if self.command != "HEAD":
+                    with open(path, "rb") as f:
+                        shutil.copyfileobj(f, self.wfile, CHUNK_SIZE)
+            elif kind == "refs":
+                digest = store.get_ref(name)
+                if digest is None:
+                    self._reply(404)
+                else:
+                    self._reply(200, digest.encode("utf-8"))
+            elif kind == "metrics" and not name:
+                self._reply(
+                    200,
+                    METRICS.to_prometheus().encode("utf-8"),
+                    "text/plain; version=0.0.4",
+                )
+            else:
+                self._reply(404)
+        except ValueError as e:
+            self._reply(400, str(e).encode("utf-8"))
+
+    do_GET = _serve_get
+    do_HEAD = _serve_get
+
+    def do_PUT(self):
+        store = self.server.store
+        kind, name = self._route()
+        length = int(self.headers.get("Content-Length", "0"))
+        try:
+            if kind == "blobs":
+                _check_digest(name)
+                with TemporaryFile() as tmp:
+                    remaining = length
+                    while remaining > 0:
+                        chunk = self.rfile.read(min(CHUNK_SIZE, remaining))
+                        if not chunk:
+                            break
+                        tmp.write(chunk)
+                        remaining -= len(chunk)
+                    tmp.seek(0)
+                    store.put(tmp, digest=name)
+                self._reply(201)
+            elif kind == "refs":
+                digest = self.rfile.read(length).decode("utf-8").strip()
+                _check_digest(digest)
+                if_match = self.headers.get("If-Match")
+                if_none_match = self.headers.get("If-None-Match")
+                if if_match is not None:
+                    updated = store.compare_and_set_ref(
+                        name, if_match.strip().strip('"'), digest
+                    )
+                elif if_none_match is not None and if_none_match.strip() == "*":
+                    updated = store.compare_and_set_ref(name, None, digest)
+                else:
+                    store.set_ref(name, digest)
+                    updated = True
+                self._reply(204 if updated else 412)
+            else:
+                self._reply(404)
+        except ValueError as e:
+            self._reply(400, str(e).encode("utf-8"))
+
+
+class _StoreHTTPServer(ThreadingHTTPServer):
+    daemon_threads = True
+
+    def __init__(self, address: Tuple[str, int], store: DirectoryStore):
+        super().__init__(address, _StoreRequestHandler)
+        self.store: DirectoryStore = store
+
+
+class RemoteCacheServer:
+    """Serves a `DirectoryStore` over HTTP"""
+
+    def __init__(self, store: DirectoryStore, host: str = "127.0.0.1", port: int = 0):
+        self.host: str = host
+        self.server = _StoreHTTPServer((host, port), store)
+        self._thread: Optional[threading.Thread] = None
+
+    @property
+    def url(self) -> str:
+        return f"http://{self.host}:{self.server.server_port}"
+
+    def serve_forever(self):
+        try:
+            self.server.serve_forever()
+        finally:
+            self.server.server_close()
+
+    def __enter__(self) -> "RemoteCacheServer":
+        self._thread = threading.Thread(target=self.server.serve_forever, daemon=True)
+        self._thread.start()
+        return self
+
+    def __exit__(self, exc_type, exc_val, exc_tb):
+        self.server.shutdown()
+        self.server.server_close()
+
+
+def database_ref(package_manager: PackageManager) -> str:
+    config = package_manager.config
+    name = package_manager.with_sources_id(
+        f"{package_manager.NAME}_{config.os}_{config.os_version}_{config.arch}"
+    )
+    return f"db/{name}.sqlite3.gz"
+
+
+def source_digest(root: Path) -> str:
+    """
+    Identifies the source tree that the step containers copy from `root`: its absolute
+    path along with the path, size, and modification time of every file in it.
+    """
+    root = root.absolute()
+    h = hashlib.sha256(str(root).encode("utf-8") + b"\0")
+    for directory, subdirectories, filenames in os.walk(root):
+        subdirectories.sort()
+        for filename in sorted(filenames):
+            path = Path(directory) / filename
+            try:
+                stat = path.lstat()
+            except OSError:
+                continue
+            relative = str(path.relative_to(root))
+            h.update(f"{relative}\0{stat.st_size}\0{stat.st_mtime_ns}\n".encode())
+    return h.hexdigest()
+
+
+def resolution_key(
+    package_manager: PackageManager,
+    commands: Sequence[Sequence[str]],
+    source: Optional[str] = None,
+    database: Optional[str] = None,
+) -> str:
+    """Identifies the resolution of `commands` in `package_manager`'s configuration,
+    against the source tree with digest `source` and the package database with
+    fingerprint `database`"""
+    config = package_manager.config
+    key = json.dumps(
+        {
+            "package_manager": package_manager.NAME,
+            "config": [config.os, config.os_version, config.arch],
+            "commands": [list(c) for c in commands],
+            "source": source,
+            "database": database,
+        },
+        sort_keys=True,
+    )
+    return hashlib.sha256(key.encode("utf-8")).hexdigest()
+
+
+class SharedCache:
+    """Shares package databases, infeasible package sequences, and results through a
+    `BlobStore`. Failures to reach the store are logged and otherwise ignored so that
+    an unavailable store never fails a resolution."""
+
+    def __init__(self, store: BlobStore, source_root: Optional[Path] = None):
+        self.store: BlobStore = store
+        # the directory that the step containers copy as the source tree
+        self.source_root: Path = Path.cwd() if source_root is None else source_root
+        self._source_digest: Optional[str] = None
+        self._database_fingerprints: Dict[PackageManager, Optional[str]] = {}
+
+    def _key(self, cache: Cache, commands: Sequence[Sequence[str]]) -> str:
+        if self._source_digest is None:
+            self._source_digest = source_digest(self.source_root)
+        package_manager = cache.package_manager
+        if package_manager not in self._database_fingerprints:
+            self._database_fingerprints[package_manager] = cache.fingerprint()
+        return resolution_key(
+            package_manager,
+            commands,
+            source=self._source_digest,
+            database=self._database_fingerprints[package_manager],
+        )
+
+    def _safely(self, description: str, func, *args, default=None):
+        try:
+            return func(*args)
+        except (OSError, ValueError, RemoteStoreError) as e:
+            logger.warning(f"Unable to {description} the remote cache: {e!s}")
+            return default
+
+    def fetch_database(self, package_manager: PackageManager) -> bool:
+        """Downloads the package database for `package_manager` if the store has it"""
+        return self._safely(
+            "download a package database from",
+            self._fetch_database,
+            package_manager,
+            default=False,
+        )
+
+    def _fetch_database(self, package_manager: PackageManager) -> bool:
+        digest = self.store.get_ref(database_ref(package_manager))
+        if digest is None:
+            return False
+        path = SQLCache.path(package_manager)
+        partial = path.with_name(f"{path.name}.part")
+        with TemporaryFile() as compressed:
+            if not self.store.get(digest, compressed):
+                return False
+            compressed.seek(0)
+            with gzip.open(compressed, "rb") as gz, open(partial, "wb") as out:
+                shutil.copyfileobj(gz, out, CHUNK_SIZE)
+        os.replace(partial, path)
+        logger.info(
+            f"Downloaded the package database from {database_ref(package_manager)}"
+        )
+        return True
+
+    def publish_database(self, package_manager: PackageManager):
+        self._safely(
+            "upload a package database to", self._publish_database, package_manager
+        )
+
+    def _publish_database(self, package_manager: PackageManager):
+        path = SQLCache.path(package_manager)
+        with TemporaryFile() as compressed:
+            with open(path, "rb") as f, gzip.GzipFile(
+                fileobj=compressed, mode="wb", mtime=0
+            ) as gz:
+                shutil.copyfileobj(f, gz, CHUNK_SIZE)
+            compressed.seek(0)
+            digest = self.store.put(compressed)
+        self.store.set_ref(database_ref(package_manager), digest)
+
+    def prepare(self, generator: SBOMGenerator, commands: Sequence[Sequence[str]]):
+        """Primes `generator` with what other machines have discovered about resolving
+        `commands`: known-infeasible package sequences are skipped, and the decisions of
+        earlier results are tried first"""
+        key = self._key(generator.cache, commands)
+        infeasible = self._safely(
+            "read infeasible sequences from",
+            self.store.get_json,
+            f"infeasible/{key}",
+            default=None,
+        )
+        for packages in infeasible or ():
+            generator.infeasible.add(SBOM(packages))
+        results = self._safely(
+            "read results from", self.store.get_json, f"results/{key}", default=None
+        )
+        for result in results or ():
+            generator.hints.update(result.get("packages", ()))
+            generator.add_seed(
+                Decision.from_json(d) for d in result.get("decisions", ())
+            )
+        if infeasible or results:
+            logger.info(
+                f"Loaded {len(results or ())} result(s) and {len(infeasible or ())} "
+                "infeasible package sequence(s) from the remote cache"
+            )
+
+    def publish(
+        self,
+        generator: SBOMGenerator,
+        commands: Sequence[Sequence[str]],
+        results: Iterable[Resolution] = (),
+    ):
+        """Merges what `generator` discovered about resolving `commands` into the store"""
+        key = self._key(generator.cache, commands)
+        self._safely(
+            "upload infeasible sequences to",
+            self._merge,
+            f"infeasible/{key}",
+            [sorted(sbom) for sbom in generator.infeasible],
+            sorted,
+        )
+        self._safely(
+            "upload results to",
+            self._merge,
+            f"results/{key}",
+            [r.to_json() for r in results],
+            lambda r: r["packages"],
+        )
+
+    def _merge(self, name: str, new: List[Any], key_of: Callable[[Any], Any]):
+        if not new:
+            return
+        for _ in range(MERGE_ATTEMPTS):
+            current = self.store.get_ref(name)
+            existing: List[Any] = []
+            if current is not None:
+                data = self.store.get_bytes(current)
+                if data is not None:
+                    existing = json.loads(data)
+            merged: Dict[Tuple[str, ...], Any] = {tuple(key_of(v)): v for v in existing}
+            changed = False
+            for value in new:
+                k = tuple(key_of(value))
+                if k not in merged:
+                    merged[k] = value
+                    changed = True
+            if not changed:
+                return
+            digest = self.store.put_bytes(
+                json.dumps([merged[k] for k in sorted(merged)], sort_keys=True).encode(
+                    "utf-8"
+                )
+            )
+            # another client may have merged its own entries since we read the ref
+            if self.store.compare_and_set_ref(name, current, digest):
+                return
+        raise RemoteStoreError(
+            f"{name} kept changing concurrently; gave up after {MERGE_ATTEMPTS} attempts"
+        )
@@ -0,0 +1,599 @@
+import base64
+import gzip
+import hashlib
+import json
+import threading
+from dataclasses import dataclass, field
+from logging import getLogger
+from pathlib import Path
+from typing import (
+    Any,
+    Dict,
+    FrozenSet,
+    Iterable,
+    Iterator,
+    List,
+    Optional,
+    Protocol,
+    Tuple,
+    Type,
+    Union,
+    cast,
+)
+
+from docker.client import DockerClient
+from docker.models.images import Image
+from rich.console import Console
+from rich.progress import Progress
+
+from .cache import Cache
+from .containers import Container, DockerContainer, Execution
+from .dependencies import SBOMGenerator, SBOMGeneratorStep
+from .exceptions import SBOMGenerationError
+from .package_manager import PackageManager, PackagingConfig
+
+logger = getLogger(__name__)
+
+
+class UnrecordedStateError(SBOMGenerationError):
+    pass
+
+
+def _encode(data: Optional[bytes]) -> Optional[str]:
+    if data is None:
+        return None
+    return base64.b64encode(data).decode("ascii")
+
+
+def _decode(data: Optional[str]) -> Optional[bytes]:
+    if data is None:
+        return None
+    return base64.b64decode(data)
+
+
+@dataclass
+class StateRecording:
+    """Everything observed about the container for a single explored state, which is
+    the sequence of commands being resolved and the set of installed packages"""
+
+    commands: Tuple[str, ...]
+    packages: Tuple[str, ...]
+    # the (command, exit code, output) of every `exec_run` while setting up the image
+    execs: List[Tuple[str, int, bytes]] = field(default_factory=list)
+    exit_code: Optional[int] = None
+    output: Optional[bytes] = None
+    trace: Optional[bytes] = None
+    files: Dict[str, bool] = field(default_factory=dict)
+
+    @property
+    def key(self) -> str:
+        return state_key(self.commands, self.packages)
+
+    @property
+    def output_digest(self) -> Optional[str]:
+        if self.output is None:
+            return None
+        return hashlib.sha256(self.output).hexdigest()
+
+    def to_json(self) -> Dict[str, Any]:
+        return {
+            "commands": list(self.commands),
+            "packages": list(self.packages),
+            "execs": [
+                {"command": cmd, "exit_code": code, "output": _encode(output)}
+                for cmd, code, output in self.execs
+            ],
+            "exit_code": self.exit_code,
+            "output": _encode(self.output),
+            "output_sha256": self.output_digest,
+            "files": self.files,
+        }
+
+    @classmethod
+    def from_json(cls, data: Dict[str, Any]) -> "StateRecording":
+        return cls(
+            commands=tuple(data["commands"]),
+            packages=tuple(data["packages"]),
+            execs=[
+                (e["command"], e["exit_code"], _decode(e["output"]) or b"")
+                for e in data["execs"]
+            ],
+            exit_code=data["exit_code"],
+            output=_decode(data["output"]),
+            files=data["files"],
+        )
+
+
+def state_key(commands: Iterable[str], packages: Iterable[str]) -> str:
+    state = json.dumps([list(commands), sorted(packages)])
+    return hashlib.sha256(state.encode("utf-8")).hexdigest()
+
+
+def step_state(step: SBOMGeneratorStep) -> Tuple[Tuple[str, ...], Tuple[str, ...]]:
+    """Returns the commands and installed packages that identify the state of `step`"""
+    commands: List[str] = []
+    node: Union[SBOMGeneratorStep, Container, Image] = step
+    while isinstance(node, SBOMGeneratorStep):
+        if not commands or commands[-1] != node.full_command:
+            commands.append(node.full_command)
+        node = node.parent
+    return tuple(reversed(commands)), tuple(sorted(step.sbom))
+
+
+class StateSource(Protocol):
+    """Anything that can serve the states and cache lookups of a replayed resolution"""
+
+    @property
+    def package_manager(self) -> PackageManager: ...
+
+    def state(
+        self, commands: Iterable[str], packages: Iterable[str]
+    ) -> Optional[StateRecording]: ...
+
+    def lookup(self, filename: str) -> FrozenSet[str]: ...
+
+    def lookups(self) -> Iterator[Tuple[str, FrozenSet[str]]]: ...
+
+
+class RecordingStore:
+    """A directory of state recordings.
+
+    Each state is saved as `{key}.json`, with its strace log compressed alongside it in
+    `{key}.trace.gz`. The package manager configuration and every package cache lookup
+    are saved in `session.json`, so a recording can be replayed without the package
+    cache.
+
+    """
+
+    def __init__(self, path: Union[str, Path]):
+        self.path: Path = Path(path)
+        self._lock = threading.Lock()
+        self._states: Dict[str, StateRecording] = {}
+        self._session: Dict[str, Any] = {"package_manager": None, "lookups": {}}
+        session_path = self.path / "session.json"
+        if session_path.exists():
+            with open(session_path, "r") as f:
+                self._session = json.load(f)
+
+    @property
+    def exists(self) -> bool:
+        return (self.path / "session.json").exists()
+
+    def _save_session(self):
+        self.path.mkdir(parents=True, exist_ok=True)
+        with open(self.path / "session.json", "w") as f:
+            json.dump(self._session, f)
+
+    def record_package_manager(self, package_manager: PackageManager):
+        with self._lock:
+            self._session["package_manager"] = {
+                "name": package_manager.NAME,
+                "os": package_manager.config.os,
+                "os_version": package_manager.config.os_version,
+                "arch": package_manager.config.arch,
+            }
+            self._save_session()
+
+    @property
+    def package_manager(self) -> PackageManager:
+        pm = self._session.get("package_manager")
+        if pm is None:
+            raise ValueError(f"{self.path!s} does not contain a recording")
+        return PackageManager.MANAGERS_BY_NAME[pm["name"]](
+            PackagingConfig(os=pm["os"], os_version=pm["os_version"], arch=pm["arch"])
+        )
+
+    def record_lookup(self, filename: str, packages: FrozenSet[str]):
+        self.record_lookups({filename: packages})
+
+    def record_lookups(self, found: Dict[str, FrozenSet[str]]):
+        with self._lock:
+            lookups = self._session["lookups"]
+            changed = False
+            for filename, packages in found.items():
+                if lookups.get(filename) != sorted(packages):
+                    lookups[filename] = sorted(packages)
+                    changed = True
+            if changed:
+                self._save_session()
+
+    def lookup(self, filename: str) -> FrozenSet[str]:
+        try:
+            return frozenset(self._session["lookups"][filename])
+        except KeyError:
+            raise UnrecordedStateError(
+                f"The package cache lookup of {filename!r} was not recorded"
+            )
+
+    def lookups(self) -> Iterator[Tuple[str, FrozenSet[str]]]:
+        for filename, packages in self._session["lookups"].items():
+            yield filename, frozenset(packages)
+
+    def save(self, state: StateRecording):
+        key = state.key
+        with self._lock:
+            self._states[key] = state
+            self.path.mkdir(parents=True, exist_ok=True)
+            with open(self.path / f"{key}.json", "w") as f:
+                json.dump(state.to_json(), f)
+            if state.trace is not None:
+                with gzip.open(self.path / f"{key}.trace.gz", "wb") as g:
+                    g.write(state.trace)
+
+    def state(
+        self, commands: Iterable[str], packages: Iterable[str]
+    ) -> Optional[StateRecording]:
+        key = state_key(commands, packages)
+        with self._lock:
+            if key in self._states:
+                return self._states[key]
+            path = self.path / f"{key}.json"
+            if not path.exists():
+                return None
+            with open(path, "r") as f:
+                state = StateRecording.from_json(json.load(f))
+            trace_path = self.path / f"{key}.trace.gz"
+            if trace_path.exists():
+                with gzip.open(trace_path, "rb") as g:
+                    state.trace = g.read()
+            self._states[key] = state
+            return state
+
+
+class RecordingCache(Cache):
+    """Wraps another cache, recording every lookup to a `RecordingStore`"""
+
+    def __init__(self, cache: Cache, store: RecordingStore):
+        super().__init__(cache.package_manager)
+        self.cache: Cache = cache
+        self.store: RecordingStore = store
+
+    def __iter__(self) -> Iterator[Tuple[str, FrozenSet[str]]]:
+        return iter(self.cache)
+
+    @classmethod
+    def exists(cls, package_manager: PackageManager) -> bool:
+        return False
+
+    def packages_providing(self, filename: str) -> FrozenSet[str]:
+        packages = self.cache.packages_providing(filename)
+        self.store.record_lookup(filename, packages)
+        return packages
+
+    def packages_providing_many(
+        self, filenames: Iterable[str]
+    ) -> Dict[str, FrozenSet[str]]:
+        found = self.cache.packages_providing_many(filenames)
+        self.store.record_lookups(found)
+        return found
+
+    def save(self):
+        self.cache.save()
+
+    @classmethod
+    def from_disk(cls, package_manager: PackageManager) -> "RecordingCache":
+        raise NotImplementedError("Recording caches must wrap an existing cache")
+
+    def delete(self):
+        self.cache.delete()
+
+    def fingerprint(self) -> Optional[str]:
+        return self.cache.fingerprint()
+
+    def close(self):
+        self.cache.close()
+
+
+class ReplayCache(Cache):
+    """A package cache that only knows about the lookups in a recording"""
+
+    def __init__(self, store: StateSource):
+        super().__init__(store.package_manager)
+        self.store: StateSource = store
+
+    def __iter__(self) -> Iterator[Tuple[str, FrozenSet[str]]]:
+        return self.store.lookups()
+
+    @classmethod
+    def exists(cls, package_manager: PackageManager) -> bool:
+        return False
+
+    def packages_providing(self, filename: str) -> FrozenSet[str]:
+        return self.store.lookup(filename)
+
+    def save(self):
+        pass
+
+    @classmethod
+    def from_disk(cls, package_manager: PackageManager) -> "ReplayCache":
+        raise NotImplementedError("Replay caches are loaded from a RecordingStore")
+
+    def delete(self):
+        pass
+
+
+class RecordingDockerContainer:
+    """Proxies a Docker container, recording the result of every `exec_run` in `state`"""
+
+    def __init__(self, container: DockerContainer, state: StateRecording):
+        self._container: DockerContainer = container
+        self._state: StateRecording = state
+
+    def exec_run(self, cmd: str, *args, **kwargs) -> Tuple[int, bytes]:
+        retval, output = self._container.exec_run(cmd, *args, **kwargs)
+        self._state.execs.append((cmd, retval, output))
+        return retval, output
+
+    def __getattr__(self, name: str):
+        return getattr(self._container, name)
+
+
+class ReplayDockerContainer:
+    """Stands in for a Docker container while setting up a replayed image"""
+
+    def __init__(self, state: StateRecording):
+        self.state: StateRecording = state
+        self.id: str = state.key
+        self.short_id: str = state.key[:12]
+        self._execs: Iterator[Tuple[str, int, bytes]] = iter(state.execs)
+
+    def exec_run(self, cmd: str, *args, **kwargs) -> Tuple[int, bytes]:
+        recorded = next(self._execs, None)
+        if recorded is None or recorded[0] != cmd:
+            raise UnrecordedStateError(
+                f"`{cmd}` was not recorded for packages {', '.join(self.state.packages)}"
+            )
+        return recorded[1], recorded[2]
+
+
+class RecordingStep(SBOMGeneratorStep):
+    @property
+    def store(self) -> RecordingStore:
+        return cast(RecordingSBOMGenerator, self.generator).store
+
+    @property
+    def recording(self) -> StateRecording:
+        if getattr(self, "_recording", None) is None:
+            commands, packages = step_state(self)
+            self._recording: Optional[StateRecording] = StateRecording(
+                commands=commands, packages=packages
+            )
+        return self._recording  # type: ignore
+
+    def setup_image(self, container: DockerContainer):
+        # start every (re)creation of the image from a clean slate
+        self.recording.execs = []
+        try:
+            super().setup_image(
+                RecordingDockerContainer(container, self.recording)  # type: ignore
+            )
+        finally:
+            # save once the setup is complete, including the execs before a failure
+            self.store.save(self.recording)
+
+    def trace(self) -> Execution:
+        exe = super().trace()
+        self.recording.exit_code = exe.exit_code
+        self.recording.output = exe.output
+        with open(self.trace_log, "rb") as f:
+            self.recording.trace = f.read()
+        self.store.save(self.recording)
+        return exe
+
+    def files_exist(
+        self, *paths: Path | str, progress: Progress | None = None
+    ) -> dict[str, bool]:
+        result = super().files_exist(*paths, progress=progress)
+        self.recording.files.update(result)
+        self.store.save(self.recording)
+        return result
+
+
+class RecordingSBOMGenerator(SBOMGenerator):
+    """Resolves dependencies as usual, recording every state that is explored"""
+
+    def __init__(
+        self,
+        cache: Cache,
+        store: RecordingStore,
+        console: Optional[Console] = None,
+        interactive: bool = True,
+        hints: Optional[set] = None,
+    ):
+        store.record_package_manager(cache.package_manager)
+        super().__init__(
+            RecordingCache(cache, store),
+            console=console,
+            interactive=interactive,
+            hints=hints,
+        )
+        self.store: RecordingStore = store
+        # recordings only capture runs of the whole command
+        self.rerun_failing_subprocess = False
+
+    @property
+    def step_class(self) -> Type[SBOMGeneratorStep]:
+        return RecordingStep
+
+
+class ReplayExecution(Execution):
+    def __init__(self, container: "ReplayContainer", exit_code: int, output: bytes):
+        self.container: Container = container
+        self._closed = False
+        self._output: bytes | None = output
+        self._exit_code: int | None = exit_code
+
+    @property
+    def done(self) -> bool:
+        self.close()
+        return True
+
+    @property  # type: ignore
+    def exit_code(self) -> int:
+        self.close()
+        return self._exit_code  # type: ignore
+
+    @property
+    def output(self) -> bytes:
+        self.close()
+        return self._output  # type: ignore
+
+    def kill(self):
+        self.close()
+
+    def close(self):
+        if self._closed:
+            return
+        self._closed = True
+        self.container.__exit__(None, None, None)
+
+    def logs(self, scrollback: int = -1) -> bytes:
+        if scrollback < 0:
+            return self.output
+        return self.output[-scrollback:]
+
+
+class ReplayContainer(Container):
+    """A `Container` that serves recorded results instead of running Docker"""
+
+    def __init__(
+        self,
+        parent: Optional[Union["ReplayContainer", Image, str]],
+        client: Optional[DockerClient] = None,
+        image_name: Optional[str] = None,
+    ):
+        if image_name is None and not isinstance(parent, Container):
+            image_name = "trailofbits/deptective-replay"
+        super().__init__(parent, client=client, image_name=image_name)  # type: ignore
+        self._running: bool = False
+
+    def default_client(self) -> DockerClient:
+        return None  # type: ignore
+
+    def load_image(self, name: str) -> Image:
+        # the parent is never run, so it does not need to exist
+        return name  # type: ignore
+
+    def replay_state(self) -> StateRecording:
+        raise NotImplementedError()
+
+    def replay_docker_container(self) -> DockerContainer:
+        """Returns the stand-in for the Docker container passed to `setup_image`"""
+        return ReplayDockerContainer(self.replay_state())  # type: ignore
+
+    @property
+    def image(self) -> Image:
+        raise ValueError("Replayed containers do not have Docker images")
+
+    def start(self):
+        if self._running:
+            raise ValueError("The container is already started!")
+        if isinstance(self.parent, Container):
+            _ = self.parent.__enter__()
+        try:
+            self.setup_image(self.replay_docker_container())
+        except BaseException:
+            if isinstance(self.parent, Container):
+                self.parent.__exit__(None, None, None)
+            raise
+        self._running = True
+
+    def stop(self):
+        if not self._running:
+            raise ValueError("The container is not running!")
+        self._running = False
+        if isinstance(self.parent, Container):
+            self.parent.__exit__(None, None, None)
+
+    def create(self, *args, **kwargs) -> DockerContainer:
+        raise NotImplementedError("Replayed containers cannot create Docker containers")
+
+    def run(
+        self,
+        command: Union[str, List[str]],
+        workdir: str = "/workdir",
+        entrypoint: str = "/bin/sh",
+        environment: Optional[List[str]] = None,
+    ) -> Execution:
+        state = self.replay_state()
+        if state.exit_code is None:
+            raise UnrecordedStateError(
+                f"The command was never run with packages {', '.join(state.packages)}"
+            )
+        self.__enter__()  # the execution calls self.__exit__(...) when it is closed
+        return ReplayExecution(self, state.exit_code, state.output or b"")
+
+    def files_exist(
+        self, *paths: Path | str, progress: Progress | None = None
+    ) -> dict[str, bool]:
+        state = self.replay_state()
+        ret: dict[str, bool] = {}
+        for path in {str(p) for p in paths}:
+            if path not in state.files:
+                raise UnrecordedStateError(
+                    f"The existence of {path!r} was not recorded for packages"
+                    f" {', '.join(state.packages)}"
+                )
+            ret[path] = state.files[path]
+        return ret
+
+
+class ReplayStep(SBOMGeneratorStep, ReplayContainer):
+    @property
+    def store(self) -> StateSource:
+        return cast(ReplaySBOMGenerator, self.generator).store
+
+    def replay_state(self) -> StateRecording:
+        commands, packages = step_state(self)
+        state = self.store.state(commands, packages)
+        if state is None:
+            raise UnrecordedStateError(
+                f"`{commands[-1]}` was never recorded with packages"
+                f" {', '.join(packages) or '(none)'}"
+            )
+        return state
+
+    def run(
+        self,
+        command: Union[str, List[str]],
+        workdir: str = "/workdir",
+        entrypoint: str = "/bin/sh",
+        environment: Optional[List[str]] = None,
+    ) -> Execution:
+        state = self.replay_state()
+        with open(self.trace_log, "wb") as f:
+            f.write(state.trace or b"")
+        return super().run(command, workdir=workdir, entrypoint=entrypoint)
+
+
+class ReplaySBOMGenerator(SBOMGenerator):
+    """Resolves dependencies entirely from a recording, without Docker"""
+
+    def __init__(
+        self,
+        store: StateSource,
+        console: Optional[Console] = None,
+        interactive: bool = True,
+        hints: Optional[set] = None,
+    ):
+        super().__init__(
+            ReplayCache(store), console=console, interactive=interactive, hints=hints
+        )
+        self.store: StateSource = store
+        self.rerun_failing_subprocess = False
+
+    @property
+    def step_class(self) -> Type[SBOMGeneratorStep]:
+        return ReplayStep
+
+    @property
+    def client(self) -> DockerClient:
+        return None  # type: ignore
+
+    @property
+    def deptective_strace_image(self) -> Image:
+        return "deptective-replay"  # type: ignore
+
+    @property
+    def image_name(self) -> str:
+        return "trailofbits/deptective-replay"
@@ -0,0 +1,203 @@
+import fcntl
+import logging
+import os
+import threading
+import time
+from dataclasses import dataclass, replace
+from pathlib import Path
+from typing import Any, Dict, List, Optional, Tuple
+
+from docker.client import DockerClient
+
+from .metrics import CONTAINER_QUEUE_DELAY
+from .profiling import span
+
+logger = logging.getLogger(__name__)
+
+# the fraction of the Docker host's memory that is divided among the slots
+MEMORY_FRACTION = 0.8
+# no container is limited to less memory than this, in bytes
+MIN_MEMORY = 512 * 1024 * 1024
+# how often a waiting step checks whether a slot was released, in seconds
+POLL_INTERVAL = 0.1
+
+
+def cpu_ranges(cpus: List[int]) -> str:
+    """Formats CPU numbers as a Docker cpuset, e.g., `[0, 1, 2, 5]` becomes `0-2,5`"""
+    ranges: List[List[int]] = []
+    for cpu in sorted(cpus):
+        if ranges and ranges[-1][1] == cpu - 1:
+            ranges[-1][1] = cpu
+        else:
+            ranges.append([cpu, cpu])
+    return ",".join(str(a) if a == b else f"{a}-{b}" for a, b in ranges)
+
+
+@dataclass
+class HostCapacity:
+    cpus: int
+    memory: int
+
+    @classmethod
+    def from_client(cls, client: DockerClient) -> "HostCapacity":
+        """The CPUs and memory of the Docker host, which may be a VM rather than this machine"""
+        info = client.info()
+        return cls(
+            cpus=max(1, int(info.get("NCPU") or os.cpu_count() or 1)),
+            memory=int(info.get("MemTotal") or 0),
+        )
+
+
+@dataclass
+class Slot:
+    """A share of the Docker host that one container at a time may use"""
+
+    index: int
+    cpuset: Optional[str] = None
+    nano_cpus: Optional[int] = None
+    mem_limit: Optional[int] = None
+    # how long the step waited for this slot, in seconds
+    queue_delay: float = 0.0
+
+    def container_limits(self) -> Dict[str, Any]:
+        """Keyword arguments for `containers.create` and `containers.run`"""
+        limits: Dict[str, Any] = {}
+        if self.cpuset is not None:
+            limits["cpuset_cpus"] = self.cpuset
+        if self.nano_cpus is not None:
+            limits["nano_cpus"] = self.nano_cpus
+        if self.mem_limit is not None:
+            limits["mem_limit"] = self.mem_limit
+        return limits
+
+
+class _HeldSlot:
+    def __init__(self, slot: Slot, fd: int):
+        self.slot: Slot = slot
+        self.fd: int = fd
+        self.references: int = 1
+
+
+class StepScheduler:
+    """
+    Limits how many step containers run at once on a Docker host, giving each an equal
+    share of its CPUs and memory.
+
+    Slots are claimed by locking files in a directory, so every deptective process that
+    uses the same directory shares the same slots. A thread that already holds a slot,
+    e.g., while setting up an image that in turn runs a container, reuses it rather
+    than waiting for a second one, so nested containers cannot deadlock.
+    """
+
+    def __init__(self):
+        self.enabled: bool = False
+        self.slots: List[Slot] = []
+        self.directory: Optional[Path] = None
+        self._local = threading.local()
+        self._held: Dict[int, _HeldSlot] = {}
+        self._lock = threading.Lock()
+
+    def enable(self, capacity: HostCapacity, parallelism: int, directory: Path):
+        if parallelism < 1:
+            raise ValueError("The parallelism must be at least one")
+        directory.mkdir(parents=True, exist_ok=True)
+        self.directory = directory
+        self.slots = self.partition(capacity, parallelism)
+        self.enabled = True
+        logger.debug(
+            f"Scheduling at most {parallelism} containers at once: "
+            + "; ".join(str(slot.container_limits()) for slot in self.slots)
+        )
+
+    @staticmethod
+    def partition(capacity: HostCapacity, parallelism: int) -> List[Slot]:
+        """Divides the host into `parallelism` slots"""
+        memory: Optional[int] = None
+        if capacity.memory > 0:
+            memory = max(
+                MIN_MEMORY, int(capacity.memory * MEMORY_FRACTION / parallelism)
+            )
+        slots: List[Slot] = []
+        if capacity.cpus >= parallelism:
+            # disjoint cpusets, so that a busy container cannot slow down the others
+            per_slot, extra = divmod(capacity.cpus, parallelism)
+            first = 0
+            for i in range(parallelism):
+                count = per_slot + (1 if i < extra else 0)
+                slots.append(
+                    Slot(
+                        index=i,
+                        cpuset=cpu_ranges(list(range(first, first + count))),
+                        mem_limit=memory,
+                    )
+                )
+                first += count
+        else:
+            # more slots than CPUs, so share them through CFS quotas instead
+            nano_cpus = capacity.cpus * 1_000_000_000 // parallelism
+            slots.extend(
+                Slot(index=i, nano_cpus=nano_cpus, mem_limit=memory)
+                for i in range(parallelism)
+            )
+        return slots
+
+    def _try_claim(self) -> Optional[Tuple[Slot, int]]:
+        """Locks the first free slot, returning it along with the locked file descriptor"""
+        assert self.directory is not None
+        for slot in self.slots:
+            fd = os.open(
+                self.directory / f"slot-{slot.index}.lock", os.O_RDWR | os.O_CREAT
+            )
+            try:
+                fcntl.flock(fd, fcntl.LOCK_EX | fcntl.LOCK_NB)
+            except BlockingIOError:
+                os.close(fd)
+                continue
+            return slot, fd
+        return None
+
+    def acquire(self, **span_args: Any) -> Optional[Slot]:
+        """
+        Blocks until a slot is free and claims it, returning None if scheduling is
+        disabled. Every slot that is returned must be passed to `release`.
+        """
+        if not self.enabled:
+            return None
+        current: Optional[_HeldSlot] = getattr(self._local, "held", None)
+        if current is not None:
+            with self._lock:
+                if current.references > 0:
+                    current.references += 1
+                    return current.slot
+        start = time.perf_counter()
+        with span("scheduler.wait", **span_args) as attrs:
+            while (claimed := self._try_claim()) is None:
+                time.sleep(POLL_INTERVAL)
+            slot, fd = claimed
+            delay = time.perf_counter() - start
+            attrs["slot"] = slot.index
+            attrs["queue_delay"] = delay
+        CONTAINER_QUEUE_DELAY.observe(delay)
+        acquired = replace(slot, queue_delay=delay)
+        held = _HeldSlot(acquired, fd)
+        with self._lock:
+            self._held[id(acquired)] = held
+        self._local.held = held
+        return acquired
+
+    def release(self, slot: Optional[Slot]):
+        if slot is None:
+            return
+        with self._lock:
+            held = self._held.get(id(slot))
+            if held is None:
+                return
+            held.references -= 1
+            if held.references > 0:
+                return
+            del self._held[id(slot)]
+        fcntl.flock(held.fd, fcntl.LOCK_UN)
+        os.close(held.fd)
+
+
+SCHEDULER = StepScheduler()
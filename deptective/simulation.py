@@ -0,0 +1,408 @@
+import itertools
+import os
+import random
+import shlex
+from dataclasses import dataclass, field
+from typing import Dict, FrozenSet, Iterable, Iterator, List, Optional, Set, Tuple
+
+from rich.console import Console
+
+from .apt import Apt
+from .containers import DockerContainer
+from .dependencies import InvocationResult
+from .package_manager import PackageManager, PackagingConfig
+from .replay import ReplaySBOMGenerator, ReplayStep, StateRecording
+from .strace import Invocation, ProcessTree
+
+DEFAULT_CONFIG = PackagingConfig(os="ubuntu", os_version="noble", arch="amd64")
+
+
+@dataclass
+class SyntheticPackage:
+    name: str
+    # the files that the package actually installs
+    files: Tuple[str, ...] = ()
+    # the files that the package index claims the package provides; defaults to `files`
+    indexed_files: Optional[Tuple[str, ...]] = None
+    depends: Tuple[str, ...] = ()
+    installable: bool = True
+
+    @property
+    def index(self) -> Tuple[str, ...]:
+        if self.indexed_files is None:
+            return self.files
+        return self.indexed_files
+
+
+@dataclass
+class SyntheticCommand:
+    name: str
+    # the absolute paths the command accesses, in order; the command fails at the first
+    # one that does not exist
+    requires: Tuple[str, ...] = field(default_factory=tuple)
+    # directories that the command lists before accessing `requires`, opening every file
+    # in them (e.g., to load plugins)
+    lists: Tuple[str, ...] = field(default_factory=tuple)
+    # temporary files that the command creates before running `runs` and removes after
+    created: Tuple[str, ...] = field(default_factory=tuple)
+    # the names of the commands that it then runs as subprocesses, in order; it fails
+    # with the first one that fails
+    runs: Tuple[str, ...] = field(default_factory=tuple)
+
+
+class _CommandCapture:
+    """Records the commands a package manager would run in a container"""
+
+    def __init__(self):
+        self.commands: List[str] = []
+
+    def exec_run(self, cmd: str, *args, **kwargs) -> Tuple[int, bytes]:
+        self.commands.append(cmd)
+        return 0, b""
+
+
+class PackageUniverse:
+    """A synthetic package repository and set of commands that can be resolved by a
+    `SimulatedSBOMGenerator` in place of Docker and a real package cache.
+
+    It implements the `StateSource` protocol, so every state of a resolution is
+    computed on demand rather than recorded.
+
+    """
+
+    PATH: Tuple[str, ...] = ("/usr/local/bin", "/usr/bin", "/bin")
+    # the PID of the simulated command; its subprocesses are numbered after it
+    ROOT_PID: int = 100
+
+    def __init__(
+        self,
+        packages: Iterable[SyntheticPackage],
+        commands: Iterable[SyntheticCommand],
+        package_manager: Optional[PackageManager] = None,
+    ):
+        self.packages: Dict[str, SyntheticPackage] = {p.name: p for p in packages}
+        self.commands: Dict[str, SyntheticCommand] = {c.name: c for c in commands}
+        if package_manager is None:
+            package_manager = Apt(DEFAULT_CONFIG)
+        self._package_manager: PackageManager = package_manager
+        self._index: Dict[str, Set[str]] = {}
+        for package in self.packages.values():
+            for path in package.index:
+                self._index.setdefault(path.lstrip("/"), set()).add(package.name)
+        self.states_computed: int = 0
+
+    @property
+    def package_manager(self) -> PackageManager:
+        return self._package_manager
+
+    def closure(self, packages: Iterable[str]) -> Set[str]:
+        """Returns `packages` and all of their transitive dependencies"""
+        installed: Set[str] = set()
+        stack = list(packages)
+        while stack:
+            name = stack.pop()
+            if name in installed:
+                continue
+            installed.add(name)
+            stack.extend(self.packages[name].depends)
+        return installed
+
+    def installable(self, packages: Iterable[str]) -> bool:
+        return all(self.packages[p].installable for p in self.closure(packages))
+
+    def installed_files(self, packages: Iterable[str]) -> Set[str]:
+        files: Set[str] = set()
+        for name in self.closure(packages):
+            files.update(self.packages[name].files)
+        return files
+
+    def _command_path(self, command: str, installed: Set[str]) -> str:
+        if command.startswith("/"):
+            return command
+        for directory in self.PATH:
+            if f"{directory}/{command}" in installed:
+                return f"{directory}/{command}"
+        return f"{self.PATH[0]}/{command}"
+
+    def run(self, command: str, packages: Iterable[str]) -> StateRecording:
+        """Simulates running `command` with `packages` installed"""
+        trace: List[str] = []
+        files: Dict[str, bool] = {}
+        pids = itertools.count(self.ROOT_PID)
+        exit_code, output = self._run_process(
+            command.split(" ")[0],
+            next(pids),
+            pids,
+            self.installed_files(packages),
+            set(),
+            trace,
+            files,
+        )
+        return StateRecording(
+            commands=(command,),
+            packages=tuple(sorted(packages)),
+            exit_code=exit_code,
+            output=output,
+            trace="\n".join(trace).encode("utf-8") + b"\n",
+            files=files,
+        )
+
+    def _run_process(
+        self,
+        name: str,
+        pid: int,
+        pids: Iterator[int],
+        installed: Set[str],
+        created: Set[str],
+        trace: List[str],
+        files: Dict[str, bool],
+    ) -> Tuple[int, bytes]:
+        """Simulates a process running `name`, appending what strace would log to
+        `trace`, and returns its exit code and output"""
+        spec = self.commands.get(name, SyntheticCommand(name))
+        executable = self._command_path(name, installed)
+        execve = (
+            f'{pid} execve("{executable}", ["{name}"], ["PATH={":".join(self.PATH)}"])'
+        )
+        if executable not in installed:
+            trace.append(f"{execve} = -1 ENOENT (No such file or directory)")
+            trace.append(f"{pid} +++ exited with 127 +++")
+            files[executable] = False
+            return 127, f"{name}: command not found\n".encode("utf-8")
+        trace.append(f"{execve} = 0")
+        files[executable] = True
+        exit_code = 0
+        output = b"ok\n"
+        for directory in spec.lists:
+            entries = sorted(p for p in installed if os.path.dirname(p) == directory)
+            exists = any(p.startswith(f"{directory}/") for p in installed)
+            files[directory] = exists
+            if not exists:
+                trace.append(
+                    f'{pid} openat(AT_FDCWD, "{directory}", O_RDONLY|O_DIRECTORY) = -1'
+                    " ENOENT (No such file or directory)"
+                )
+                continue
+            trace.append(
+                f'{pid} openat(AT_FDCWD, "{directory}", O_RDONLY|O_DIRECTORY) = 3'
+            )
+            for entry in entries:
+                files[entry] = True
+                trace.append(
+                    f'{pid} openat(AT_FDCWD, "{entry}", O_RDONLY|O_CLOEXEC) = 4'
+                )
+        for path in spec.created:
+            created.add(path)
+            trace.append(
+                f'{pid} openat(AT_FDCWD, "{path}", O_WRONLY|O_CREAT|O_TRUNC, 0666) = 3'
+            )
+        for subprocess in spec.runs:
+            child = next(pids)
+            trace.append(
+                f"{pid} clone(child_stack=NULL, flags=CLONE_CHILD_CLEARTID|SIGCHLD)"
+                f" = {child}"
+            )
+            exit_code, output = self._run_process(
+                subprocess, child, pids, installed, created, trace, files
+            )
+            if exit_code != 0:
+                break
+        for path in spec.created:
+            created.discard(path)
+            files[path] = path in installed
+            trace.append(f'{pid} unlink("{path}") = 0')
+        if exit_code == 0:
+            for path in spec.requires:
+                exists = path in installed or path in created
+                files[path] = path in installed
+                if exists:
+                    trace.append(
+                        f'{pid} openat(AT_FDCWD, "{path}", O_RDONLY|O_CLOEXEC) = 3'
+                    )
+                else:
+                    trace.append(
+                        f'{pid} openat(AT_FDCWD, "{path}", O_RDONLY|O_CLOEXEC) = -1 ENOENT'
+                        " (No such file or directory)"
+                    )
+                    exit_code = 1
+                    output = f"{name}: {path}: No such file or directory\n".encode(
+                        "utf-8"
+                    )
+                    break
+        trace.append(f"{pid} +++ exited with {exit_code} +++")
+        return exit_code, output
+
+    def state(
+        self, commands: Iterable[str], packages: Iterable[str]
+    ) -> Optional[StateRecording]:
+        commands = tuple(commands)
+        packages = tuple(packages)
+        if any(p not in self.packages for p in packages):
+            return None
+        self.states_computed += 1
+        state = self.run(commands[-1], packages)
+        state.commands = commands
+        return state
+
+    def lookup(self, filename: str) -> FrozenSet[str]:
+        return frozenset(self._index.get(filename, ()))
+
+    def lookups(self) -> Iterator[Tuple[str, FrozenSet[str]]]:
+        for filename, packages in self._index.items():
+            yield filename, frozenset(packages)
+
+    @classmethod
+    def generate(
+        cls,
+        packages: int = 1000,
+        depth: int = 4,
+        providers: int = 1,
+        decoys: int = 2,
+        files_per_package: int = 10,
+        dependencies: int = 2,
+        seed: int = 0,
+    ) -> "PackageUniverse":
+        """Generates a random universe of about `packages` packages with a command `app`.
+
+        `app` needs one file from each of `depth` packages, in order. Each of those
+        files is installed by `providers` packages, so there are `providers ** depth`
+        feasible results. Each file is also claimed by `decoys` packages in the index:
+        half of them fail to install, and the other half install without actually
+        providing the file. Every package depends on up to `dependencies` other packages.
+
+        """
+        rng = random.Random(seed)
+        names = [f"pkg{i:06d}" for i in rng.sample(range(packages * 10), packages)]
+        universe: List[SyntheticPackage] = []
+        for i, name in enumerate(names):
+            # only depend on earlier packages so the dependency graph is acyclic
+            depends = tuple(
+                {names[rng.randrange(i)] for _ in range(rng.randint(0, dependencies))}
+                if i
+                else ()
+            )
+            universe.append(
+                SyntheticPackage(
+                    name=name,
+                    files=tuple(
+                        f"/usr/lib/{name}/file{j}.so" for j in range(files_per_package)
+                    ),
+                    depends=depends,
+                )
+            )
+        requires: List[str] = []
+        for level in range(depth):
+            provider = universe[rng.randrange(packages)]
+            path = rng.choice(provider.files)
+            requires.append(path)
+            for alternative in range(1, providers):
+                universe.append(
+                    SyntheticPackage(
+                        name=f"{provider.name}-alt{alternative}", files=(path,)
+                    )
+                )
+            for decoy in range(decoys):
+                universe.append(
+                    SyntheticPackage(
+                        name=f"{provider.name}-decoy{decoy}",
+                        indexed_files=(path,),
+                        installable=decoy % 2 == 1,
+                    )
+                )
+        universe.append(SyntheticPackage(name="app", files=("/usr/bin/app",)))
+        return cls(universe, [SyntheticCommand("app", tuple(requires))])
+
+
+class SimulatedDockerContainer:
+    """Stands in for the Docker container while setting up a simulated image"""
+
+    def __init__(self, step: "SimulatedStep"):
+        self.step: SimulatedStep = step
+        self.id: str = f"simulated-{id(step):x}"
+        self.short_id: str = self.id[:12]
+        capture = _CommandCapture()
+        step.generator.cache.package_manager.install(capture, *step.preinstall)  # type: ignore
+        self._install_commands: Set[str] = set(capture.commands)
+        # the packages installed so far, before and then after the preinstall
+        self._packages: Set[str] = set(step.sbom) - step.preinstall
+
+    @property
+    def universe(self) -> PackageUniverse:
+        return self.step.store  # type: ignore
+
+    def exec_run(self, cmd: str, *args, **kwargs) -> Tuple[int, bytes]:
+        if cmd == "printenv PATH":
+            return 0, ":".join(PackageUniverse.PATH).encode("utf-8") + b"\n"
+        elif cmd in self._install_commands:
+            if not self.universe.installable(self.step.sbom):
+                return (
+                    100,
+                    b"E: Unable to correct problems, you have held broken packages.",
+                )
+            self._packages = set(self.step.sbom)
+            return 0, b""
+        # emulate the queries of a Debian container
+        program, *arguments = shlex.split(cmd)
+        if program == "dpkg-query":
+            return 0, "".join(
+                f"installed {name}\n"
+                for name in sorted(self.universe.closure(self._packages))
+            ).encode("utf-8")
+        elif program == "dpkg" and arguments[:1] == ["-L"]:
+            paths: Set[str] = set()
+            for name in arguments[1:]:
+                for path in self.universe.packages[name].files:
+                    while path != "/":
+                        paths.add(path)
+                        path = os.path.dirname(path)
+            return 0, "".join(f"{path}\n" for path in sorted(paths)).encode("utf-8")
+        elif program == "/usr/bin/deptective-files-exist":
+            installed = self.universe.installed_files(self._packages)
+            return 0, "".join(
+                f"{path}\n" for path in arguments if path not in installed
+            ).encode("utf-8")
+        return 0, b""
+
+
+class SimulatedStep(ReplayStep):
+    def replay_docker_container(self) -> DockerContainer:
+        generator: SimulatedSBOMGenerator = self.generator  # type: ignore
+        generator.nodes_explored += 1
+        return SimulatedDockerContainer(self)  # type: ignore
+
+    def run_invocation(self, invocation: Invocation) -> InvocationResult:
+        generator: SimulatedSBOMGenerator = self.generator  # type: ignore
+        generator.invocations_run += 1
+        state = generator.universe.run(invocation.argv[0], self.sbom)
+        processes = ProcessTree.from_lines(
+            (state.trace or b"").decode("utf-8").splitlines(), cwd=invocation.cwd
+        )
+        return InvocationResult(
+            exit_code=state.exit_code,  # type: ignore
+            output=state.output or b"",
+            missing_files=processes.missing_files,
+        )
+
+
+class SimulatedSBOMGenerator(ReplaySBOMGenerator):
+    """Resolves dependencies against a synthetic `PackageUniverse`"""
+
+    def __init__(
+        self,
+        universe: PackageUniverse,
+        console: Optional[Console] = None,
+        interactive: bool = False,
+        hints: Optional[set] = None,
+    ):
+        super().__init__(
+            universe, console=console, interactive=interactive, hints=hints
+        )
+        self.universe: PackageUniverse = universe
+        self.nodes_explored: int = 0
+        self.invocations_run: int = 0
+        # unlike a recording, the universe can run any subprocess on its own
+        self.rerun_failing_subprocess = True
+
+    @property
+    def step_class(self):
+        return SimulatedStep
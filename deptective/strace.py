@@ -1,7 +1,19 @@
+import os
 import re
+from dataclasses import dataclass, field
 from functools import wraps
 from logging import getLogger
-from typing import Callable, Iterator
+from typing import (
+    Callable,
+    Dict,
+    FrozenSet,
+    Iterable,
+    Iterator,
+    List,
+    Optional,
+    Set,
+    Tuple,
+)
 
 logger = getLogger(__name__)
 
@@ -322,3 +334,253 @@ def lazy_parse_paths(line: str) -> Iterator[str]:
             yield result.value
         else:
             text.offset += 1
+
+
+pid_pattern = re.compile(r"\s*(?P<pid>\d+)\s+(?P<text>.*)$")
+exited_pattern = re.compile(r"\+\+\+\s*exited with (?P<code>\d+)\s*\+\+\+")
+killed_pattern = re.compile(r"\+\+\+\s*killed by (?P<signal>\w+)")
+result_pattern = re.compile(
+    r"\)\s+=\s+(?P<retval>-?\d+|\?|0x[0-9a-fA-F]+)(?:\s+(?P<errno>E[A-Z0-9]+)\b[^=]*)?$"
+)
+FORK_SYSCALLS = frozenset({"clone", "clone3", "fork", "vfork"})
+
+
+@dataclass
+class Process:
+    pid: int
+    parent: Optional["Process"] = None
+    children: List["Process"] = field(default_factory=list)
+    # the program, arguments, and environment of the most recent successful execve, which
+    # are inherited from the parent until the process calls execve itself
+    executable: Optional[str] = None
+    argv: Optional[Tuple[str, ...]] = None
+    env: Optional[Tuple[str, ...]] = None
+    execed: bool = False
+    cwd: Optional[str] = None
+    # relative directory changes made before the process's parent was known
+    pending_chdirs: List[str] = field(default_factory=list)
+    exit_code: Optional[int] = None
+    killed: bool = False
+    # the order in which the process exited, or -1 if it has not
+    exit_order: int = -1
+    # the paths that the process looked for but that did not exist
+    missing: Set[str] = field(default_factory=set)
+
+    @property
+    def failed(self) -> bool:
+        return self.killed or self.exit_code not in (None, 0)
+
+
+@dataclass(frozen=True)
+class Invocation:
+    """A single process from a trace that can be run again on its own"""
+
+    executable: str
+    argv: Tuple[str, ...]
+    cwd: str
+    env: Tuple[str, ...]
+    exit_code: int
+    # the paths that the process and its descendants looked for but did not find
+    missing_files: FrozenSet[str] = frozenset()
+
+    def __str__(self):
+        return " ".join(self.argv)
+
+
+def _strings(arg: Arg) -> Optional[Tuple[str, ...]]:
+    """The strings in a list argument, or None if the list was truncated or elided"""
+    if not isinstance(arg, ListArg) or any(not item.quoted for item in arg.items):
+        return None
+    return tuple(item.value for item in arg.items)
+
+
+class ProcessTree:
+    """Reconstructs the processes of a command from its `strace -f -v -e
+    trace=file,process` log, along with the program, arguments, environment, working
+    directory, exit code, and missing files of each"""
+
+    def __init__(self, cwd: str = "/workdir"):
+        self.initial_cwd: str = cwd
+        self.processes: Dict[int, Process] = {}
+        self.root: Optional[Process] = None
+        self._unfinished: Dict[int, str] = {}
+        self._exits: int = 0
+
+    @classmethod
+    def from_lines(cls, lines: Iterable[str], cwd: str = "/workdir") -> "ProcessTree":
+        tree = cls(cwd=cwd)
+        for line in lines:
+            tree.feed(line)
+        return tree
+
+    def process(self, pid: int) -> Process:
+        process = self.processes.get(pid)
+        if process is None:
+            process = Process(pid)
+            if self.root is None:
+                self.root = process
+                process.cwd = self.initial_cwd
+            self.processes[pid] = process
+        return process
+
+    @property
+    def missing_files(self) -> FrozenSet[str]:
+        return frozenset().union(*(p.missing for p in self.processes.values()))
+
+    def feed(self, line: str):
+        line = line.rstrip("\n")
+        m = pid_pattern.match(line)
+        if m:
+            pid, text = int(m.group("pid")), m.group("text")
+        else:
+            # strace only prefixes lines with the PID when it follows forks
+            pid = self.root.pid if self.root is not None else 0
+            text = line.strip()
+        process = self.process(pid)
+        if text.endswith("<unfinished ...>"):
+            self._unfinished[pid] = text[: -len("<unfinished ...>")].rstrip()
+            return
+        m = strace_resumed_pattern.match(text)
+        if m:
+            prefix = self._unfinished.pop(pid, None)
+            if prefix is None:
+                prefix = f"{m.group('syscall')}("
+            text = f"{prefix}{m.group('remainder')}"
+        m = exited_pattern.match(text)
+        if m:
+            process.exit_code = int(m.group("code"))
+            process.exit_order = self._exits
+            self._exits += 1
+            return
+        m = killed_pattern.match(text)
+        if m:
+            process.killed = True
+            process.exit_order = self._exits
+            self._exits += 1
+            return
+        syscall, _, args = text.partition("(")
+        result = result_pattern.search(args)
+        if not syscall or result is None:
+            return
+        retval, errno = result.group("retval"), result.group("errno")
+        if syscall in FORK_SYSCALLS:
+            if retval.isdigit() and int(retval) > 0:
+                self._fork(process, self.process(int(retval)))
+        elif syscall == "execve" and retval == "0":
+            self._execve(process, text)
+        elif syscall == "chdir" and retval == "0":
+            path = next(lazy_parse_paths(args), None)
+            if path is None:
+                process.cwd = None
+            elif path.startswith("/"):
+                process.cwd = os.path.normpath(path)
+            elif process.cwd is not None:
+                process.cwd = os.path.normpath(os.path.join(process.cwd, path))
+            elif process.parent is None and process is not self.root:
+                # the child ran before strace reported which process created it
+                process.pending_chdirs.append(path)
+        elif syscall == "fchdir":
+            # the directory is only known by its file descriptor
+            process.cwd = None
+        elif errno == "ENOENT":
+            # the first string argument of a file syscall is the path it looked for
+            path = next(lazy_parse_paths(args), None)
+            relative_to = process.cwd
+            if syscall.endswith("at") and not args.startswith("AT_FDCWD"):
+                relative_to = None
+            if path is not None and path.startswith("/"):
+                process.missing.add(os.path.normpath(path))
+            elif path and relative_to is not None:
+                process.missing.add(os.path.normpath(os.path.join(relative_to, path)))
+
+    def _fork(self, parent: Process, child: Process):
+        if child.parent is not None or child is self.root:
+            return
+        child.parent = parent
+        parent.children.append(child)
+        if child.cwd is None and parent.cwd is not None:
+            child.cwd = os.path.normpath(
+                os.path.join(parent.cwd, *child.pending_chdirs)
+            )
+        if not child.execed:
+            child.executable = parent.executable
+            child.argv = parent.argv
+            child.env = parent.env
+
+    def _execve(self, process: Process, text: str):
+        ctx = ParsingContext(text, len("execve("))
+        try:
+            executable = parse_quoted_string(ctx).value
+            ctx.expect(",")
+            argv = _strings(parse_syscall_arg(ctx))
+            ctx.expect(",")
+            env = _strings(parse_syscall_arg(ctx))
+        except ParseError:
+            executable, argv, env = "", None, None
+        if executable and not executable.startswith("/") and process.cwd is not None:
+            executable = os.path.normpath(os.path.join(process.cwd, executable))
+        process.executable = executable or None
+        process.argv = argv
+        process.env = env
+        process.execed = True
+
+    def _subtree_missing(self) -> Dict[int, Set[str]]:
+        missing: Dict[int, Set[str]] = {}
+        # children always start after their parents, so visit them in reverse
+        for process in reversed(list(self.processes.values())):
+            subtree = set(process.missing)
+            for child in process.children:
+                subtree |= missing.get(child.pid, set())
+            missing[process.pid] = subtree
+        return missing
+
+    def failing_invocation(
+        self, missing_files: Optional[Iterable[str]] = None
+    ) -> Optional[Invocation]:
+        """Returns the invocation that is most likely responsible for the command failing:
+        the last process to exit unsuccessfully, other than the command itself, that
+        called execve, and (if `missing_files` is provided) that looked for at least one
+        of `missing_files`. Its failing ancestors that also meet those criteria are
+        preferred, because a descendant such as a compiler's back end often depends on
+        temporary files created by its parent."""
+        relevant = None if missing_files is None else set(missing_files)
+        subtree_missing = self._subtree_missing()
+
+        def qualifies(p: Process) -> bool:
+            return (
+                p is not self.root
+                and p.execed
+                and not p.killed
+                and p.failed
+                and p.executable is not None
+                and p.argv is not None
+                and p.env is not None
+                and p.cwd is not None
+                and (relevant is None or bool(subtree_missing[p.pid] & relevant))
+            )
+
+        qualifying = {p.pid for p in self.processes.values() if qualifies(p)}
+        has_qualifying_descendant: Set[int] = set()
+        for process in reversed(list(self.processes.values())):
+            if process.parent is not None and (
+                process.pid in qualifying or process.pid in has_qualifying_descendant
+            ):
+                has_qualifying_descendant.add(process.parent.pid)
+        leaves = [
+            self.processes[pid]
+            for pid in qualifying
+            if pid not in has_qualifying_descendant
+        ]
+        if not leaves:
+            return None
+        chosen = max(leaves, key=lambda p: p.exit_order)
+        while chosen.parent is not None and chosen.parent.pid in qualifying:
+            chosen = chosen.parent
+        return Invocation(
+            executable=chosen.executable,  # type: ignore
+            argv=chosen.argv,  # type: ignore
+            cwd=chosen.cwd,  # type: ignore
+            env=chosen.env,  # type: ignore
+            exit_code=chosen.exit_code,  # type: ignore
+            missing_files=frozenset(subtree_missing[chosen.pid]),
+        )
@@ -0,0 +1,132 @@
+"""A corpus of strace logs for testing and benchmarking the strace parser.
+
+Each `corpus/{name}.strace.gz` log is accompanied by `corpus/{name}.golden.gz`, which
+records what the parser extracted from every line of the log when the golden file was
+generated. Any change to the parser can then be checked line by line against the
+behavior of the parser it replaces.
+
+The make, cmake, python, and node logs are real recordings, in the format of
+`strace -f -e trace=file`, of workloads run as root in `/workdir` on Debian 12:
+
+* make: `make -j4` building a small C project with gcc 12;
+* cmake: `cmake -S . -B build` configuring a C/C++ project that looks for Threads, ZLIB,
+  PkgConfig, and CURL, and checks for headers and functions;
+* python: Python 3.11 importing several standard modules and then failing to import
+  `lxml`, which is not installed; and
+* node: `npm ls` with npm 10 and Node.js 20 in an empty directory.
+
+They were captured with a ptrace-based recorder that writes strace's output format
+for the file syscalls, since strace was not installed on the recording machine. The java
+log is still synthetic. Lines that the parser cannot parse, such as `<unfinished ...>`
+lines and truncated `execve` arguments, are recorded as errors in the golden files.
+
+To record a new trace (strace must be installed) and generate its golden file:
+
+    python test/strace_corpus.py record NAME -- COMMAND [ARGS...]
+
+To regenerate every golden file after an intentional change to the parser's output:
+
+    python test/strace_corpus.py golden
+
+"""
+
+import argparse
+import gzip
+import json
+import shutil
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+from typing import Any, Dict, Iterator, List, Tuple
+
+from deptective.strace import ParseError, lazy_parse_paths, parse_strace_log_line
+
+CORPUS_DIR = Path(__file__).absolute().parent / "corpus"
+# the same options that `deptective-strace` passes to strace unless it traces processes
+STRACE_ARGS = ("-f", "-e", "trace=file")
+
+
+def trace_names() -> List[str]:
+    return sorted(p.name[: -len(".strace.gz")] for p in CORPUS_DIR.glob("*.strace.gz"))
+
+
+def trace_path(name: str) -> Path:
+    return CORPUS_DIR / f"{name}.strace.gz"
+
+
+def golden_path(name: str) -> Path:
+    return CORPUS_DIR / f"{name}.golden.gz"
+
+
+def read_trace(name: str) -> List[str]:
+    with gzip.open(trace_path(name), "rt", encoding="utf-8") as f:
+        return f.readlines()
+
+
+def parse_line(line: str) -> Dict[str, Any]:
+    """Returns everything the parser extracts from a single line of an strace log"""
+    result: Dict[str, Any] = {"paths": list(lazy_parse_paths(line))}
+    try:
+        syscall, args, retval = parse_strace_log_line(line)
+        result["syscall"] = syscall
+        result["args"] = [[str(arg), arg.quoted] for arg in args]
+        result["retval"] = retval
+    except ParseError as e:
+        result["error"] = e.__class__.__name__
+    return result
+
+
+def read_golden(name: str) -> Iterator[Tuple[int, Dict[str, Any]]]:
+    with gzip.open(golden_path(name), "rt", encoding="utf-8") as f:
+        for lineno, line in enumerate(f, start=1):
+            yield lineno, json.loads(line)
+
+
+def write_golden(name: str):
+    with gzip.GzipFile(golden_path(name), "wb", mtime=0) as f:
+        for line in read_trace(name):
+            f.write(json.dumps(parse_line(line), sort_keys=True).encode("utf-8"))
+            f.write(b"\n")
+
+
+def record(name: str, command: List[str]) -> int:
+    strace = shutil.which("strace")
+    if strace is None:
+        raise RuntimeError("strace is not installed")
+    with tempfile.TemporaryDirectory() as tmpdir:
+        log = Path(tmpdir) / "strace.txt"
+        retval = subprocess.call([strace, *STRACE_ARGS, "-o", str(log), *command])
+        with gzip.GzipFile(trace_path(name), "wb", mtime=0) as f:
+            f.write(log.read_bytes())
+    write_golden(name)
+    return retval
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="manages the strace test corpus")
+    subparsers = parser.add_subparsers(dest="action", required=True)
+    record_parser = subparsers.add_parser(
+        "record", help="records a new trace and its golden file"
+    )
+    record_parser.add_argument("NAME", help="the name of the trace")
+    record_parser.add_argument("COMMAND", nargs=argparse.REMAINDER)
+    subparsers.add_parser("golden", help="regenerates the golden file of every trace")
+    args = parser.parse_args()
+    if args.action == "record":
+        command = args.COMMAND
+        if command and command[0] == "--":
+            command = command[1:]
+        if not command:
+            parser.error("a command to record is required")
+        retval = record(args.NAME, command)
+        print(f"Recorded {trace_path(args.NAME)} (exit code {retval})")
+    else:
+        for name in trace_names():
+            write_golden(name)
+            print(f"Wrote {golden_path(name)}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
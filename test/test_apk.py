@@ -0,0 +1,70 @@
+from io import BytesIO
+from unittest import TestCase
+
+from deptective.apk import Apk, iter_apkindex, iter_apkindex_paths, provided_paths
+from deptective.package_manager import PackageManager, PackagingConfig
+
+APKINDEX = b"""C:Q1abc=
+P:curl
+V:8.9.1-r0
+A:x86_64
+D:ca-certificates so:libc.musl-x86_64.so.1 so:libcurl.so.4
+p:cmd:curl=8.9.1-r0
+
+C:Q1def=
+P:libcurl
+V:8.9.1-r0
+A:x86_64
+p:so:libcurl.so.4=4.8.0
+
+P:zlib-dev
+V:1.3.1-r1
+p:pc:zlib=1.3.1
+
+P:alpine-baselayout
+V:3.6.5-r0
+"""
+
+
+class ApkTests(TestCase):
+    def test_registered(self):
+        self.assertIs(Apk, PackageManager.MANAGERS_BY_NAME["apk"])
+
+    def test_apkindex(self):
+        self.assertEqual(
+            [
+                ("curl", ["cmd:curl=8.9.1-r0"]),
+                ("libcurl", ["so:libcurl.so.4=4.8.0"]),
+                ("zlib-dev", ["pc:zlib=1.3.1"]),
+                ("alpine-baselayout", []),
+            ],
+            list(iter_apkindex(BytesIO(APKINDEX))),
+        )
+        paths = set(iter_apkindex_paths(BytesIO(APKINDEX)))
+        self.assertIn(("usr/bin/curl", "curl"), paths)
+        self.assertIn(("usr/lib/libcurl.so.4", "libcurl"), paths)
+        self.assertIn(("usr/lib/pkgconfig/zlib.pc", "zlib-dev"), paths)
+
+    def test_provided_paths(self):
+        self.assertEqual(
+            ("lib/libz.so.1", "usr/lib/libz.so.1"), provided_paths("so:libz.so.1=1")
+        )
+        # virtual packages do not correspond to files
+        self.assertEqual((), provided_paths("musl-utils"))
+
+    def test_install_command(self):
+        pm = Apk(PackagingConfig(os="alpine", os_version="3.20.3", arch="x86_64"))
+        self.assertEqual(
+            "apk add curl zlib-dev", pm.install_command(["curl", "zlib-dev"])
+        )
+
+    def test_versions(self):
+        pm = Apk(PackagingConfig(os="alpine", os_version="3.20.3", arch="x86_64"))
+        self.assertEqual("v3.20", pm.repository_version)
+        self.assertTrue(
+            pm.index_url("main").endswith("/v3.20/main/x86_64/APKINDEX.tar.gz")
+        )
+        self.assertIn("FROM alpine:3.20", pm.dockerfile())
+        edge = Apk(PackagingConfig(os="alpine", os_version="edge", arch="aarch64"))
+        self.assertEqual("edge", edge.repository_version)
+        self.assertIn("FROM alpine:edge", edge.dockerfile())
@@ -0,0 +1,90 @@
+import gzip
+import shutil
+import subprocess
+from pathlib import Path
+from tempfile import TemporaryDirectory
+from unittest import TestCase, skipIf
+from unittest.mock import patch
+
+from deptective.apt import (
+    LISTS_ENV,
+    MIRROR_ENV,
+    SOURCES_ENV,
+    Apt,
+    local_contents_files,
+)
+from deptective.package_manager import PackagingConfig
+
+PREFIX = "archive.ubuntu.com_ubuntu_dists"
+
+
+class AptListsTest(TestCase):
+    def setUp(self):
+        self.tmpdir = TemporaryDirectory()
+        self.lists = Path(self.tmpdir.name)
+        with gzip.open(self.lists / f"{PREFIX}_noble_Contents-amd64.gz", "wb") as f:
+            f.write(b"usr/bin/gcc-13    devel/gcc-13\n")
+        (self.lists / f"{PREFIX}_noble-updates_main_Contents-amd64").write_bytes(
+            b"usr/lib/libfoo.so    libs/libfoo,libs/libfoo-dev\n"
+        )
+        # other releases and architectures are ignored
+        (self.lists / f"{PREFIX}_jammy_Contents-amd64").write_bytes(b"usr/bin/x    x\n")
+        (self.lists / f"{PREFIX}_noble_Contents-arm64").write_bytes(b"usr/bin/y    y\n")
+        (self.lists / f"{PREFIX}_noble_InRelease").write_bytes(b"")
+
+    def tearDown(self):
+        self.tmpdir.cleanup()
+
+    def test_local_contents_files(self):
+        self.assertEqual(
+            [
+                self.lists / f"{PREFIX}_noble-updates_main_Contents-amd64",
+                self.lists / f"{PREFIX}_noble_Contents-amd64.gz",
+            ],
+            local_contents_files(self.lists, "noble", "amd64"),
+        )
+        # the updates pocket alone does not cover the release
+        (self.lists / f"{PREFIX}_noble_Contents-amd64.gz").unlink()
+        self.assertEqual([], local_contents_files(self.lists, "noble", "amd64"))
+
+    @skipIf(shutil.which("lz4") is None, "the lz4 command is not installed")
+    def test_lz4(self):
+        path = self.lists / f"{PREFIX}_noble-security_Contents-amd64"
+        path.write_bytes(b"usr/bin/z    z\n")
+        subprocess.run(["lz4", "-q", "--rm", str(path), f"{path!s}.lz4"], check=True)
+        packages = dict(self.iter_packages())
+        self.assertEqual(frozenset({"z"}), packages["usr/bin/z"])
+
+    def iter_packages(self, local_arch: str = "x86_64"):
+        apt = Apt(PackagingConfig(os="ubuntu", os_version="noble", arch="amd64"))
+        local = PackagingConfig(os="ubuntu", os_version="noble", arch=local_arch)
+        with patch.dict("os.environ", {LISTS_ENV: str(self.lists)}), patch.object(
+            PackagingConfig, "get_local", return_value=local
+        ), patch("deptective.apt.urlopen", side_effect=AssertionError("no network")):
+            yield from apt.iter_packages()
+
+    def test_iter_packages(self):
+        packages = dict(self.iter_packages())
+        self.assertEqual(frozenset({"gcc-13"}), packages["usr/bin/gcc-13"])
+        self.assertEqual(
+            frozenset({"libfoo", "libfoo-dev"}), packages["usr/lib/libfoo.so"]
+        )
+        self.assertIn("usr/bin/cc", packages)
+        self.assertNotIn("usr/bin/x", packages)
+        self.assertNotIn("usr/bin/y", packages)
+
+    def test_configured_sources(self):
+        # the host's lists do not describe a mirror or sources set for the images
+        for env, value in (
+            (MIRROR_ENV, "http://localhost:8000/ubuntu"),
+            (SOURCES_ENV, "deb http://localhost:8000/ubuntu noble main"),
+        ):
+            with self.subTest(env=env), patch.dict(
+                "os.environ", {env: value}
+            ), self.assertRaises(AssertionError):
+                dict(self.iter_packages())
+
+    def test_other_host(self):
+        # a host with a different architecture downloads the database instead
+        with self.assertRaises(AssertionError):
+            dict(self.iter_packages(local_arch="aarch64"))
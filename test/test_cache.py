@@ -0,0 +1,240 @@
+import os
+from pathlib import Path
+from tempfile import TemporaryDirectory
+from typing import Tuple
+from unittest import TestCase
+from unittest.mock import patch
+
+from deptective.apt import MIRROR_ENV, SOURCES_ENV, Apt
+from deptective.bloom import BloomFilter
+from deptective.cache import (
+    CACHE_BACKENDS,
+    CacheCapacityError,
+    SharedSQLCache,
+    SQLCache,
+    bloom_path,
+)
+from deptective.metrics import CACHE_FILTERED
+from deptective.package_manager import PackagingConfig
+
+PACKAGES = [
+    ("usr/bin/cc", frozenset({"gcc", "clang"})),
+    ("usr/lib/libfoo.so", frozenset({"libfoo"})),
+]
+
+
+class CacheTests(TestCase):
+    def setUp(self):
+        self.tmpdir = TemporaryDirectory()
+        self.patch = patch("deptective.cache.CACHE_DIR", Path(self.tmpdir.name))
+        self.patch.start()
+        self.pm = Apt(PackagingConfig(os="ubuntu", os_version="noble", arch="amd64"))
+
+    def tearDown(self):
+        self.patch.stop()
+        self.tmpdir.cleanup()
+
+    def test_backends(self):
+        self.assertIs(SQLCache, CACHE_BACKENDS["sqlite"])
+        self.assertIs(SharedSQLCache, CACHE_BACKENDS["shared-sqlite"])
+
+    def test_lookup_many(self):
+        for name, backend in CACHE_BACKENDS.items():
+            with self.subTest(backend=name):
+                cache = backend.from_iterable(self.pm, PACKAGES)
+                try:
+                    self.assertEqual(frozenset({"gcc", "clang"}), cache["/usr/bin/cc"])
+                    self.assertEqual(
+                        {
+                            "usr/bin/cc": frozenset({"gcc", "clang"}),
+                            "usr/lib/libfoo.so": frozenset({"libfoo"}),
+                            "usr/lib/libbar.so": frozenset(),
+                        },
+                        cache.lookup_many(
+                            ["/usr/bin/cc", "usr/lib/libfoo.so", "/usr/lib/libbar.so"]
+                        ),
+                    )
+                finally:
+                    cache.delete()
+                    cache.close()
+
+    def test_failed_rebuild(self):
+        def interrupted():
+            yield "usr/lib/libbar.so", frozenset({"libbar"})
+            raise OSError("connection reset")
+
+        for name, backend in CACHE_BACKENDS.items():
+            with self.subTest(backend=name):
+                backend.from_iterable(self.pm, PACKAGES).close()
+                with patch.object(self.pm, "iter_packages", return_value=interrupted()):
+                    with self.assertRaises(OSError):
+                        backend.rebuild(self.pm)
+                # the existing cache is only replaced by a complete one
+                cache = backend.from_disk(self.pm)
+                try:
+                    self.assertEqual(dict(PACKAGES), cache.lookup_many(dict(PACKAGES)))
+                    updated = [("usr/lib/libbar.so", frozenset({"libbar"}))]
+                    with patch.object(self.pm, "iter_packages", return_value=updated):
+                        backend.rebuild(self.pm).close()
+                    cache.close()
+                    cache = backend.from_disk(self.pm)
+                    self.assertEqual(
+                        {"usr/bin/cc": frozenset(), **dict(updated)},
+                        cache.lookup_many(["usr/bin/cc", "usr/lib/libbar.so"]),
+                    )
+                finally:
+                    cache.delete()
+                    cache.close()
+                self.assertEqual([], [p.name for p in Path(self.tmpdir.name).iterdir()])
+
+    def test_duplicate_rows(self):
+        # e.g., the release and updates pockets both list a file
+        packages = PACKAGES + [
+            ("usr/lib/libfoo.so", frozenset({"libfoo", "libfoo-dev"}))
+        ]
+        cache = SQLCache.from_iterable(self.pm, packages)
+        try:
+            self.assertEqual(
+                frozenset({"libfoo", "libfoo-dev"}), cache["/usr/lib/libfoo.so"]
+            )
+            self.assertEqual(
+                2,
+                cache.conn.execute(
+                    "SELECT COUNT(*) FROM files WHERE filename = ?",
+                    ("usr/lib/libfoo.so",),
+                ).fetchone()[0],
+            )
+        finally:
+            cache.close()
+
+    def test_sources_paths(self):
+        def paths(**env: str) -> Tuple[str, str]:
+            with patch.dict("os.environ", env):
+                for name in (MIRROR_ENV, SOURCES_ENV):
+                    if name not in env:
+                        os.environ.pop(name, None)
+                return SQLCache.path(self.pm).name, SharedSQLCache.path(self.pm).name
+
+        default = paths()
+        self.assertEqual(
+            ("apt_ubuntu_noble_amd64.sqlite3", "apt_shared.sqlite3"), default
+        )
+        # databases built from another mirror or other sources are kept apart
+        mirror = paths(**{MIRROR_ENV: "http://localhost:8000/ubuntu"})
+        sources = paths(**{SOURCES_ENV: "deb http://localhost:8000/ubuntu noble main"})
+        self.assertEqual(3, len({default[0], mirror[0], sources[0]}))
+        self.assertEqual(3, len({default[1], mirror[1], sources[1]}))
+
+    def test_shared_membership(self):
+        jammy = Apt(PackagingConfig(os="ubuntu", os_version="jammy", arch="amd64"))
+        SharedSQLCache.from_iterable(self.pm, PACKAGES).close()
+        SharedSQLCache.from_iterable(
+            jammy,
+            [
+                ("usr/bin/cc", frozenset({"gcc"})),
+                ("usr/lib/libbar.so", frozenset({"libbar"})),
+            ],
+        ).close()
+        self.assertEqual(
+            [SharedSQLCache.path(self.pm)],
+            list(Path(self.tmpdir.name).glob("*.sqlite3")),
+        )
+        noble_cache = SharedSQLCache.from_disk(self.pm)
+        jammy_cache = SharedSQLCache.from_disk(jammy)
+        try:
+            self.assertEqual(PACKAGES, list(noble_cache))
+            self.assertEqual(frozenset({"gcc"}), jammy_cache["usr/bin/cc"])
+            self.assertFalse(noble_cache["usr/lib/libbar.so"])
+            self.assertFalse(jammy_cache["usr/lib/libfoo.so"])
+            # each path and package is stored once, with a row per (path, package)
+            conn = noble_cache.conn
+            self.assertEqual(
+                3, conn.execute("SELECT COUNT(*) FROM paths").fetchone()[0]
+            )
+            self.assertEqual(
+                4, conn.execute("SELECT COUNT(*) FROM files").fetchone()[0]
+            )
+
+            # rebuilding a configuration replaces only its own rows
+            updated = [("usr/lib/libbar.so", frozenset({"libbar2"}))]
+            with patch.object(jammy, "iter_packages", return_value=updated):
+                SharedSQLCache.rebuild(jammy).close()
+            self.assertEqual(PACKAGES, list(noble_cache))
+            self.assertEqual(updated, list(jammy_cache))
+
+            jammy_cache.delete()
+            self.assertFalse(SharedSQLCache.exists(jammy))
+            self.assertEqual(PACKAGES, list(noble_cache))
+        finally:
+            jammy_cache.close()
+            noble_cache.delete()
+            noble_cache.close()
+        self.assertFalse(SharedSQLCache.path(self.pm).exists())
+
+    def test_shared_capacity(self):
+        with patch.object(SharedSQLCache, "MAX_CONFIGS", 1):
+            SharedSQLCache.from_iterable(self.pm, PACKAGES).close()
+            jammy = Apt(PackagingConfig(os="ubuntu", os_version="jammy", arch="amd64"))
+            with self.assertRaises(CacheCapacityError):
+                SharedSQLCache.from_iterable(jammy, PACKAGES)
+            self.assertFalse(SharedSQLCache.exists(jammy))
+            self.assertTrue(SharedSQLCache.exists(self.pm))
+
+    def test_bloom_filter(self):
+        bloom_filter = BloomFilter.from_items(
+            (f"usr/lib/lib{i}.so" for i in range(1000)), capacity=1000
+        )
+        self.assertTrue(all(f"usr/lib/lib{i}.so" in bloom_filter for i in range(1000)))
+        false_positives = sum(f"etc/{i}.conf" in bloom_filter for i in range(10000))
+        self.assertLess(false_positives, 300)
+        loaded = BloomFilter.from_bytes(bloom_filter.to_bytes())
+        self.assertEqual(bloom_filter.bits, loaded.bits)
+        self.assertEqual(1000, len(loaded))
+        with self.assertRaises(ValueError):
+            BloomFilter.from_bytes(b"not a filter")
+
+    def test_lazy_bloom_filter(self):
+        for name, backend in CACHE_BACKENDS.items():
+            with self.subTest(backend=name):
+                backend.from_iterable(self.pm, PACKAGES).close()
+                db_path = backend.path(self.pm)
+                # e.g., a cache built before the filters were persisted
+                bloom_path(db_path).unlink()
+                with patch.object(backend, "_packaged_paths") as packaged_paths:
+                    cache = backend.from_disk(self.pm)
+                    cache.delete()
+                    cache.close()
+                packaged_paths.assert_not_called()
+
+                backend.from_iterable(self.pm, PACKAGES).close()
+                bloom_path(db_path).unlink()
+                cache = backend.from_disk(self.pm)
+                try:
+                    self.assertFalse(bloom_path(db_path).exists())
+                    self.assertEqual(frozenset({"libfoo"}), cache["usr/lib/libfoo.so"])
+                    self.assertTrue(bloom_path(db_path).exists())
+                finally:
+                    cache.delete()
+                    cache.close()
+
+    def test_bloom_filtered_lookups(self):
+        for name, backend in CACHE_BACKENDS.items():
+            with self.subTest(backend=name):
+                backend.from_iterable(self.pm, PACKAGES).close()
+                db_path = backend.path(self.pm)
+                self.assertTrue(bloom_path(db_path).exists())
+                cache = backend.from_disk(self.pm)
+                try:
+                    self.assertIsNotNone(cache.bloom_filter)
+                    filtered = CACHE_FILTERED.value()
+                    with patch.object(
+                        backend, "packages_providing_many", return_value={}
+                    ) as query:
+                        self.assertFalse(cache["/etc/deptective.conf"])
+                    query.assert_not_called()
+                    self.assertEqual(filtered + 1, CACHE_FILTERED.value())
+                    self.assertEqual(frozenset({"libfoo"}), cache["usr/lib/libfoo.so"])
+                finally:
+                    cache.delete()
+                    cache.close()
+                self.assertFalse(bloom_path(db_path).exists())
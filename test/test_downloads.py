@@ -0,0 +1,97 @@
+import hashlib
+import threading
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from pathlib import Path
+from tempfile import TemporaryDirectory
+from unittest import TestCase
+from unittest.mock import patch
+
+from deptective.apt import parse_release_checksum
+from deptective.logs import DownloadVerificationError, DownloadWithProgress
+
+PAYLOAD = bytes(range(256)) * 4096
+
+
+class FlakyHandler(BaseHTTPRequestHandler):
+    """Serves PAYLOAD with Range support, dropping the first connection halfway through"""
+
+    requests: list = []
+
+    def do_GET(self):
+        FlakyHandler.requests.append(self.headers.get("Range"))
+        start = 0
+        range_header = self.headers.get("Range")
+        if range_header is not None and self.headers.get("If-Range") == '"v1"':
+            start = int(range_header[len("bytes=") :].split("-")[0])
+            self.send_response(206)
+            self.send_header(
+                "Content-Range", f"bytes {start}-{len(PAYLOAD) - 1}/{len(PAYLOAD)}"
+            )
+        else:
+            self.send_response(200)
+        self.send_header("Content-Length", str(len(PAYLOAD) - start))
+        self.send_header("ETag", '"v1"')
+        self.end_headers()
+        if len(FlakyHandler.requests) == 1:
+            # simulate a connection reset partway through the first download
+            self.wfile.write(PAYLOAD[: len(PAYLOAD) // 2])
+            self.wfile.flush()
+            self.connection.close()
+            return
+        self.wfile.write(PAYLOAD[start:])
+
+    def log_message(self, format, *args):
+        pass
+
+
+class DownloadTests(TestCase):
+    def setUp(self):
+        FlakyHandler.requests = []
+        self.server = ThreadingHTTPServer(("127.0.0.1", 0), FlakyHandler)
+        self.thread = threading.Thread(target=self.server.serve_forever, daemon=True)
+        self.thread.start()
+        self.url = f"http://127.0.0.1:{self.server.server_address[1]}/Contents-amd64.gz"
+
+    def tearDown(self):
+        self.server.shutdown()
+        self.server.server_close()
+
+    @patch("deptective.logs.time.sleep")
+    def test_resume(self, _sleep):
+        with TemporaryDirectory() as tmpdir:
+            destination = Path(tmpdir) / "Contents-amd64.gz"
+            with DownloadWithProgress(
+                self.url,
+                destination=destination,
+                sha256=hashlib.sha256(PAYLOAD).hexdigest(),
+            ) as f:
+                self.assertEqual(PAYLOAD, f.read())
+            # the second request should have resumed where the first one left off
+            self.assertEqual(
+                [None, f"bytes={len(PAYLOAD) // 2}-"], FlakyHandler.requests
+            )
+            # the download is deleted after it is successfully consumed
+            self.assertFalse(destination.exists())
+
+    @patch("deptective.logs.time.sleep")
+    def test_checksum_mismatch(self, _sleep):
+        with TemporaryDirectory() as tmpdir:
+            destination = Path(tmpdir) / "Contents-amd64.gz"
+            with self.assertRaises(DownloadVerificationError):
+                with DownloadWithProgress(
+                    self.url, destination=destination, sha256="0" * 64, retries=2
+                ):
+                    pass
+            self.assertFalse(destination.exists())
+
+    def test_release_checksum(self):
+        release = (
+            "Origin: Ubuntu\n"
+            "MD5Sum:\n"
+            " d41d8cd98f00b204e9800998ecf8427e 0 Contents-amd64.gz\n"
+            "SHA256:\n"
+            " 1111111111111111111111111111111111111111111111111111111111111111 1234 Contents-arm64.gz\n"
+            " 2222222222222222222222222222222222222222222222222222222222222222 5678 Contents-amd64.gz\n"
+        )
+        self.assertEqual("2" * 64, parse_release_checksum(release, "Contents-amd64.gz"))
+        self.assertIsNone(parse_release_checksum(release, "Contents-i386.gz"))
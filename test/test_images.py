@@ -0,0 +1,165 @@
+import tarfile
+from pathlib import Path
+from tempfile import TemporaryDirectory
+from unittest import TestCase
+from unittest.mock import MagicMock, patch
+
+from docker.errors import APIError, ImageNotFound
+
+from deptective.apt import SOURCES_ENV, Apt
+from deptective.images import (
+    CONTEXT_DIGEST_LABEL,
+    build_context,
+    export_strace_image,
+    pin_parent_images,
+    strace_image,
+    strace_image_repository,
+)
+from deptective.package_manager import PackagingConfig
+
+REPOSITORY = "trailofbits/deptective-strace-apt-ubuntu-noble-amd64"
+
+
+def parent_image(reference: str) -> MagicMock:
+    image = MagicMock()
+    image.attrs = {
+        "RepoDigests": ["other@sha256:0000", f"{reference.split(':')[0]}@sha256:1234"]
+    }
+    return image
+
+
+def strace_image_client(*images: MagicMock) -> MagicMock:
+    """A client with `images`, each of which is listed under the repositories of its
+    tags"""
+    client = MagicMock()
+    client.images.get.side_effect = parent_image
+
+    def list_images(name=None, filters=None):
+        listed = [i for i in images if any(t.startswith(f"{name}:") for t in i.tags)]
+        if filters is None:
+            return listed
+        label = filters["label"]
+        return [
+            i
+            for i in listed
+            if f"{CONTEXT_DIGEST_LABEL}={i.labels.get(CONTEXT_DIGEST_LABEL)}" == label
+        ]
+
+    client.images.list.side_effect = list_images
+    return client
+
+
+class ImageTests(TestCase):
+    def test_build_context(self):
+        with TemporaryDirectory() as tmpdir:
+            root = Path(tmpdir)
+            script = root / "script"
+            script.write_text("#!/bin/sh\n")
+            script.chmod(0o755)
+            (root / "data").write_text("data\n")
+            with build_context(root, "FROM scratch\n") as context:
+                first = context.read()
+            # neither timestamps nor the order of creation affect the context
+            (root / "data").touch()
+            with build_context(root, "FROM scratch\n") as context:
+                self.assertEqual(first, context.read())
+                context.seek(0)
+                with tarfile.open(fileobj=context) as tar:
+                    members = {m.name: m for m in tar.getmembers()}
+                    self.assertEqual(["data", "script", "Dockerfile"], list(members))
+                    self.assertEqual(0o755, members["script"].mode)
+                    self.assertEqual(0, members["data"].mtime)
+                    dockerfile = tar.extractfile("Dockerfile")
+                    assert dockerfile is not None
+                    self.assertEqual(b"FROM scratch\n", dockerfile.read())
+            with build_context(root, "FROM ubuntu\n") as context:
+                self.assertNotEqual(first, context.read())
+
+    def test_pin_parent_images(self):
+        client = MagicMock()
+        client.images.get.side_effect = ImageNotFound("missing")
+        client.images.pull.side_effect = parent_image
+        self.assertEqual(
+            "FROM ubuntu@sha256:1234 AS builder\nRUN true\n"
+            "from alpine@sha256:1234\nFROM scratch\nFROM debian@sha256:5678\n",
+            pin_parent_images(
+                client,
+                "FROM ubuntu:noble AS builder\nRUN true\nfrom alpine\nFROM scratch\n"
+                "FROM debian@sha256:5678\n",
+            ),
+        )
+        self.assertEqual(
+            ["ubuntu:noble", "alpine"],
+            [c.args[0] for c in client.images.pull.call_args_list],
+        )
+
+    def test_strace_image(self):
+        pm = Apt(PackagingConfig(os="ubuntu", os_version="noble", arch="amd64"))
+        outdated = MagicMock(id="outdated", tags=[f"{REPOSITORY}:0123"], labels={})
+        client = strace_image_client(outdated)
+        built = MagicMock(tags=[])
+        dockerfiles = []
+
+        def build(fileobj, **kwargs):
+            with tarfile.open(fileobj=fileobj) as tar:
+                dockerfile = tar.extractfile("Dockerfile")
+                assert dockerfile is not None
+                dockerfiles.append(dockerfile.read())
+            return built, []
+
+        client.images.build.side_effect = build
+        self.assertIs(built, strace_image(client, pm))
+        kwargs = client.images.build.call_args.kwargs
+        self.assertTrue(kwargs["tag"].startswith(f"{REPOSITORY}:"))
+        self.assertFalse(kwargs["pull"])
+        self.assertIn(b"FROM ubuntu@sha256:1234 AS builder", dockerfiles[0])
+        # the image built by an earlier version is removed
+        client.images.remove.assert_called_once_with("outdated")
+
+        # an image built from the same context is reused without resolving its parents
+        digest = kwargs["labels"][CONTEXT_DIGEST_LABEL]
+        cached = MagicMock(
+            tags=[f"{REPOSITORY}:abcd"], labels={CONTEXT_DIGEST_LABEL: digest}
+        )
+        client = strace_image_client(outdated, cached)
+        self.assertIs(cached, strace_image(client, pm))
+        client.images.build.assert_not_called()
+        client.images.get.assert_not_called()
+
+    def test_prune_in_use(self):
+        pm = Apt(PackagingConfig(os="ubuntu", os_version="noble", arch="amd64"))
+        client = strace_image_client(
+            MagicMock(id="in-use", tags=[f"{REPOSITORY}:0123"], labels={})
+        )
+        client.images.build.return_value = (MagicMock(), [])
+        client.images.remove.side_effect = APIError("conflict")
+        strace_image(client, pm)
+        client.images.remove.assert_called_once_with("in-use")
+
+    def test_sources_repository(self):
+        pm = Apt(PackagingConfig(os="ubuntu", os_version="noble", arch="amd64"))
+        default = MagicMock(id="default", tags=[f"{REPOSITORY}:0123"], labels={})
+        sources = "deb [trusted=yes] http://localhost:8000/ubuntu noble main"
+        with patch.dict("os.environ", {SOURCES_ENV: sources}):
+            repository = strace_image_repository(pm)
+            self.assertTrue(repository.startswith(f"{REPOSITORY}_"))
+            client = strace_image_client(default)
+            client.images.build.return_value = (MagicMock(), [])
+            strace_image(client, pm)
+        self.assertTrue(
+            client.images.build.call_args.kwargs["tag"].startswith(f"{repository}:")
+        )
+        # building with other sources neither reuses nor prunes the default image
+        client.images.remove.assert_not_called()
+
+    def test_export_strace_image(self):
+        pm = Apt(PackagingConfig(os="ubuntu", os_version="noble", arch="amd64"))
+        cached = MagicMock(tags=["other:latest", f"{REPOSITORY}:abcd"], labels={})
+        cached.save.return_value = [b"image"]
+        client = strace_image_client()
+        client.images.list.side_effect = lambda **kwargs: [cached]
+        with TemporaryDirectory() as tmpdir:
+            path = Path(tmpdir) / "image.tar"
+            self.assertIs(cached, export_strace_image(client, pm, path))
+            self.assertEqual(b"image", path.read_bytes())
+        cached.save.assert_called_once_with(named=f"{REPOSITORY}:abcd")
@@ -0,0 +1,71 @@
+import json
+from pathlib import Path
+from tempfile import TemporaryDirectory
+from unittest import TestCase
+from unittest.mock import MagicMock
+
+from docker.errors import APIError
+
+from deptective.containers import Container
+from deptective.metrics import IMAGE_BYTES_COMMITTED, MetricsRegistry
+
+
+class MetricsTests(TestCase):
+    def setUp(self):
+        self.registry = MetricsRegistry()
+        self.pruned = self.registry.counter(
+            "nodes_pruned_total", "Pruned nodes", ("rule",)
+        )
+        self.latency = self.registry.histogram(
+            "step_seconds", "Step latency", buckets=(1.0, 10.0)
+        )
+
+    def test_prometheus(self):
+        self.pruned.inc(rule="superset")
+        self.pruned.inc(2, rule="infeasible")
+        self.latency.observe(0.5)
+        self.latency.observe(5)
+        text = self.registry.to_prometheus()
+        self.assertIn("# TYPE nodes_pruned_total counter", text)
+        self.assertIn('nodes_pruned_total{rule="infeasible"} 2', text)
+        self.assertIn('nodes_pruned_total{rule="superset"} 1', text)
+        self.assertIn('step_seconds_bucket{le="1"} 1', text)
+        self.assertIn('step_seconds_bucket{le="10"} 2', text)
+        self.assertIn('step_seconds_bucket{le="+Inf"} 2', text)
+        self.assertIn("step_seconds_sum 5.5", text)
+        self.assertIn("step_seconds_count 2", text)
+
+    def test_json(self):
+        self.pruned.inc(rule="irrelevant")
+        self.latency.observe(20)
+        with TemporaryDirectory() as tmpdir:
+            path = Path(tmpdir) / "metrics.json"
+            self.registry.write(path)
+            with open(path) as f:
+                metrics = json.load(f)
+        self.assertEqual(
+            [{"labels": {"rule": "irrelevant"}, "value": 1}],
+            metrics["nodes_pruned_total"]["values"],
+        )
+        self.assertEqual(1, metrics["step_seconds"]["values"][0]["buckets"]["+Inf"])
+        self.assertEqual(0, metrics["step_seconds"]["values"][0]["buckets"]["10"])
+
+    def test_labels(self):
+        with self.assertRaises(ValueError):
+            self.pruned.inc()
+        # registering the same metric twice returns the existing one
+        self.assertIs(
+            self.pruned,
+            self.registry.counter("nodes_pruned_total", "Pruned nodes", ("rule",)),
+        )
+
+    def test_image_size(self):
+        image = MagicMock()
+        image.history.return_value = [{"Size": 1024}, {"Size": 4096}]
+        committed = IMAGE_BYTES_COMMITTED.value()
+        Container._record_image_size(image)
+        self.assertEqual(committed + 1024, IMAGE_BYTES_COMMITTED.value())
+        # a failed request only loses the metric
+        image.history.side_effect = APIError("timed out")
+        Container._record_image_size(image)
+        self.assertEqual(committed + 1024, IMAGE_BYTES_COMMITTED.value())
@@ -0,0 +1,59 @@
+import json
+from pathlib import Path
+from tempfile import TemporaryDirectory
+from unittest import TestCase
+
+from deptective.profiling import Profiler
+
+
+class ProfilingTests(TestCase):
+    def test_disabled(self):
+        profiler = Profiler()
+        with profiler.span("ignored", level=0):
+            pass
+        self.assertEqual([], profiler.events)
+
+    def test_instant(self):
+        profiler = Profiler()
+        profiler.instant("ignored")
+        profiler.enable()
+        profiler.instant("prune", rule="superset", packages=["gcc"])
+        (event,) = profiler.events
+        self.assertEqual("i", event["ph"])
+        self.assertEqual({"rule": "superset", "packages": ["gcc"]}, event["args"])
+
+    def test_trace_events(self):
+        profiler = Profiler()
+        profiler.enable()
+        with profiler.span("step", level=1) as attrs:
+            with profiler.span("install", packages=["gcc"]):
+                pass
+            attrs["exit_code"] = 0
+        with self.assertRaises(ValueError):
+            with profiler.span("run"):
+                raise ValueError("oops")
+
+        with TemporaryDirectory() as tmpdir:
+            path = Path(tmpdir) / "trace.json"
+            profiler.write(path)
+            with open(path) as f:
+                trace = json.load(f)
+
+        spans = {e["name"]: e for e in trace["traceEvents"] if e["ph"] == "X"}
+        self.assertEqual({"step", "install", "run"}, set(spans))
+        self.assertEqual({"level": 1, "exit_code": 0}, spans["step"]["args"])
+        self.assertEqual(["gcc"], spans["install"]["args"]["packages"])
+        self.assertEqual("ValueError: oops", spans["run"]["args"]["error"])
+        # the inner span must be nested within the outer span
+        self.assertLessEqual(spans["step"]["ts"], spans["install"]["ts"])
+        self.assertLessEqual(
+            spans["install"]["ts"] + spans["install"]["dur"],
+            spans["step"]["ts"] + spans["step"]["dur"],
+        )
+        self.assertTrue(
+            any(
+                e["name"] == "thread_name"
+                for e in trace["traceEvents"]
+                if e["ph"] == "M"
+            )
+        )
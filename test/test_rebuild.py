@@ -0,0 +1,99 @@
+import io
+import threading
+from typing import List
+from unittest import TestCase
+from unittest.mock import patch
+
+from rich.console import Console
+
+from deptective.apt import Apt
+from deptective.cache import rebuild_caches
+from deptective.cli import rebuild_configurations
+from deptective.package_manager import PackageManager, PackagingConfig
+
+
+def configs(package_managers: List[PackageManager]) -> List[PackagingConfig]:
+    return [pm.config for pm in package_managers]
+
+
+class FakeCache:
+    """Records the package managers it is asked to rebuild, failing for `arm64`"""
+
+    rebuilt: List[PackageManager] = []
+    lock = threading.Lock()
+
+    @classmethod
+    def rebuild(cls, package_manager: PackageManager, progress=None) -> "FakeCache":
+        with cls.lock:
+            cls.rebuilt.append(package_manager)
+        if package_manager.config.arch == "arm64":
+            raise ValueError("unable to download")
+        return cls()
+
+    def close(self):
+        pass
+
+
+class RebuildTests(TestCase):
+    def test_selected_releases(self):
+        self.assertEqual(
+            [
+                PackagingConfig(os="ubuntu", os_version="jammy", arch="amd64"),
+                PackagingConfig(os="ubuntu", os_version="noble", arch="amd64"),
+            ],
+            configs(
+                rebuild_configurations("", "apt", "ubuntu", ["jammy", "noble"], "amd64")
+            ),
+        )
+
+    def test_configuration_list(self):
+        package_managers = rebuild_configurations(
+            "jammy:arm64, debian:bookworm:amd64", "apt", "ubuntu", ["noble"], "amd64"
+        )
+        self.assertTrue(all(isinstance(pm, Apt) for pm in package_managers))
+        self.assertEqual(
+            [
+                PackagingConfig(os="ubuntu", os_version="jammy", arch="arm64"),
+                PackagingConfig(os="debian", os_version="bookworm", arch="amd64"),
+            ],
+            configs(package_managers),
+        )
+
+    def test_all(self):
+        everything = [
+            Apt(PackagingConfig(os="ubuntu", os_version=release, arch="amd64"))
+            for release in ("jammy", "noble")
+        ]
+        with patch.object(Apt, "versions", return_value=iter(everything)):
+            self.assertEqual(
+                everything,
+                rebuild_configurations("all", "apt", "ubuntu", ["noble"], "amd64"),
+            )
+
+    def test_invalid_configuration(self):
+        for spec in ("jammy", "ubuntu:jammy:amd64:extra", "noble:amd64,jammy"):
+            with self.subTest(spec=spec), self.assertRaises(ValueError):
+                rebuild_configurations(spec, "apt", "ubuntu", ["noble"], "amd64")
+
+    def test_rebuild_caches(self):
+        FakeCache.rebuilt = []
+        package_managers = rebuild_configurations(
+            "jammy:amd64,jammy:arm64,noble:amd64", "apt", "ubuntu", [], "amd64"
+        )
+        errors = rebuild_caches(
+            package_managers,
+            FakeCache,  # type: ignore
+            jobs=2,
+            console=Console(file=io.StringIO()),
+        )
+        self.assertEqual(
+            sorted(configs(package_managers), key=str),
+            sorted(configs(FakeCache.rebuilt), key=str),
+        )
+        self.assertEqual(set(package_managers), set(errors.keys()))
+        self.assertIsNone(errors[package_managers[0]])
+        self.assertIsInstance(errors[package_managers[1]], ValueError)
+        self.assertIsNone(errors[package_managers[2]])
+
+    def test_rebuild_nothing(self):
+        self.assertEqual({}, rebuild_caches([], FakeCache))  # type: ignore
@@ -0,0 +1,137 @@
+import argparse
+import io
+import json
+import logging
+from typing import Dict
+from unittest import TestCase
+from unittest.mock import patch
+
+from rich.console import Console
+
+from deptective import apt  # noqa: F401
+from deptective.cli import main_multi_release
+from deptective.dependencies import SBOM
+from deptective.releases import MultiReleaseResolver, release_report
+from deptective.simulation import (
+    PackageUniverse,
+    SimulatedSBOMGenerator,
+    SyntheticCommand,
+    SyntheticPackage,
+)
+
+
+class MultiReleaseTests(TestCase):
+    def setUp(self):
+        logging.disable(logging.WARNING)
+
+    def tearDown(self):
+        logging.disable(logging.NOTSET)
+
+    def universes(self) -> Dict[str, PackageUniverse]:
+        app = SyntheticPackage("app", files=("/usr/bin/app",))
+        return {
+            "focal": PackageUniverse(
+                [app, SyntheticPackage("libfoo1", files=("/usr/lib/libfoo.so",))],
+                [SyntheticCommand("app", ("/usr/lib/libfoo.so",))],
+            ),
+            # the library was renamed, and app also needs libbar in this release
+            "jammy": PackageUniverse(
+                [
+                    app,
+                    SyntheticPackage("libfoo2", files=("/usr/lib/libfoo.so",)),
+                    SyntheticPackage("libbar", files=("/usr/lib/libbar.so",)),
+                ],
+                [SyntheticCommand("app", ("/usr/lib/libfoo.so", "/usr/lib/libbar.so"))],
+            ),
+            # nothing provides libfoo.so
+            "noble": PackageUniverse(
+                [app], [SyntheticCommand("app", ("/usr/lib/libfoo.so",))]
+            ),
+        }
+
+    def resolver(self) -> MultiReleaseResolver:
+        return MultiReleaseResolver(
+            self.universes(),  # type: ignore
+            console=Console(file=io.StringIO()),
+            generator_class=SimulatedSBOMGenerator,
+        )
+
+    def test_resolve(self):
+        resolver = self.resolver()
+        found = []
+        results = resolver.resolve(
+            lambda generator: generator.resolve(["app"]),
+            on_result=lambda release, result: found.append(release),
+        )
+        self.assertEqual(["focal", "jammy", "noble"], list(results.keys()))
+        self.assertEqual([SBOM(("app", "libfoo1"))], results["focal"].sboms)
+        self.assertEqual([SBOM(("app", "libbar", "libfoo2"))], results["jammy"].sboms)
+        self.assertEqual([], results["noble"].sboms)
+        self.assertTrue(results["focal"].succeeded)
+        self.assertTrue(results["jammy"].succeeded)
+        self.assertFalse(results["noble"].succeeded)
+        self.assertEqual({"focal", "jammy"}, set(found))
+        # every package that was found is shared with the other releases
+        self.assertEqual({"app", "libfoo1", "libfoo2", "libbar"}, resolver.hints)
+        for generator in resolver.generators.values():
+            self.assertIs(resolver.hints, generator.hints)
+
+    def test_error(self):
+        resolver = self.resolver()
+
+        def results_for(generator):
+            if generator.universe is resolver.generators["jammy"].universe:
+                raise ValueError("jammy is broken")
+            return generator.resolve(["app"])
+
+        results = resolver.resolve(results_for)
+        self.assertTrue(results["focal"].succeeded)
+        self.assertIsInstance(results["jammy"].error, ValueError)
+        self.assertFalse(results["jammy"].succeeded)
+
+    def test_release_report(self):
+        results = self.resolver().resolve(lambda generator: generator.resolve(["app"]))
+        console = Console(file=io.StringIO(), width=120, record=True)
+        console.print(release_report(results))
+        lines = console.export_text().splitlines()
+        self.assertEqual(["Package", "focal", "jammy", "noble"], lines[2].split()[1::2])
+        rows = {
+            cells[0]: [cell.strip() for cell in cells[1:]]
+            for line in lines
+            if line.startswith("│")
+            for cells in [[cell.strip() for cell in line.split("│")[1:-1]]]
+        }
+        self.assertEqual(["✔", "✔", ""], rows["app"])
+        self.assertEqual(["", "✔", ""], rows["libbar"])
+        self.assertEqual(["✔", "", ""], rows["libfoo1"])
+        # noble raised because nothing provides libfoo.so
+        self.assertEqual(["ok", "ok", "error"], rows["status"])
+
+    def test_main_multi_release(self):
+        args = argparse.Namespace(
+            search=False,
+            multi_step=False,
+            command=["app"],
+            full_reruns=False,
+            all=False,
+            num_results=1,
+            format="ndjson",
+        )
+        stdout = io.StringIO()
+        with patch("sys.stdout", stdout):
+            retval = main_multi_release(
+                args,
+                self.universes(),  # type: ignore
+                Console(file=io.StringIO()),
+                [],
+                generator_class=SimulatedSBOMGenerator,
+            )
+        # noble has no result
+        self.assertEqual(1, retval)
+        objects = [json.loads(line) for line in stdout.getvalue().splitlines()]
+        results = {o["release"]: o for o in objects if o["type"] == "result"}
+        self.assertEqual(["app", "libfoo1"], results["focal"]["packages"])
+        self.assertEqual(["app", "libfoo2", "libbar"], results["jammy"]["packages"])
+        summaries = {o["release"]: o for o in objects if o["type"] == "summary"}
+        self.assertEqual("success", summaries["focal"]["status"])
+        self.assertEqual("failure", summaries["noble"]["status"])
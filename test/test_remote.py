@@ -0,0 +1,165 @@
+import hashlib
+from pathlib import Path
+from tempfile import TemporaryDirectory
+from unittest import TestCase
+from unittest.mock import patch
+from urllib.error import HTTPError
+from urllib.request import Request, urlopen
+
+from deptective.cache import SQLCache
+from deptective.dependencies import SBOM
+from deptective.remote import (
+    DirectoryStore,
+    HTTPStore,
+    RemoteCacheServer,
+    SharedCache,
+    open_store,
+)
+from deptective.simulation import (
+    PackageUniverse,
+    SimulatedSBOMGenerator,
+    SyntheticCommand,
+    SyntheticPackage,
+)
+
+
+def universe() -> PackageUniverse:
+    return PackageUniverse(
+        [
+            SyntheticPackage("app", files=("/usr/bin/app",)),
+            SyntheticPackage(
+                "libfoo",
+                files=("/usr/lib/libfoo.so", "/usr/lib/libfoo-data.so"),
+                indexed_files=("/usr/lib/libfoo.so",),
+            ),
+            # provides libfoo.so but not the unindexed libfoo-data.so, so it is a dead end
+            SyntheticPackage("libfoo-legacy", files=("/usr/lib/libfoo.so",)),
+        ],
+        [SyntheticCommand("app", ("/usr/lib/libfoo.so", "/usr/lib/libfoo-data.so"))],
+    )
+
+
+class RemoteTests(TestCase):
+    def setUp(self):
+        self.tmpdir = TemporaryDirectory()
+        self.server = RemoteCacheServer(DirectoryStore(Path(self.tmpdir.name)))
+        self.server.__enter__()
+
+    def tearDown(self):
+        self.server.__exit__(None, None, None)
+        self.tmpdir.cleanup()
+
+    def test_store(self):
+        store = open_store(self.server.url)
+        self.assertIsInstance(store, HTTPStore)
+        data = b"deptective\n"
+        digest = store.put_bytes(data)
+        self.assertEqual(hashlib.sha256(data).hexdigest(), digest)
+        self.assertTrue(store.has(digest))
+        self.assertEqual(data, store.get_bytes(digest))
+        self.assertFalse(store.has("0" * 64))
+        self.assertIsNone(store.get_bytes("0" * 64))
+        self.assertIsNone(store.get_ref("results/app"))
+        store.set_ref("results/app", digest)
+        self.assertEqual(digest, store.get_ref("results/app"))
+        # the server wrote the blob to its directory, where a local store can read it
+        self.assertEqual(data, open_store(self.tmpdir.name).get_bytes(digest))
+
+    def test_compare_and_set_ref(self):
+        for store in (open_store(self.server.url), open_store(self.tmpdir.name)):
+            with self.subTest(store=type(store).__name__):
+                first = store.put_bytes(b"first\n")
+                second = store.put_bytes(b"second\n")
+                name = f"results/{type(store).__name__}"
+                self.assertTrue(store.compare_and_set_ref(name, None, first))
+                # the ref is no longer unset
+                self.assertFalse(store.compare_and_set_ref(name, None, second))
+                # a client that read a stale digest does not overwrite the newer one
+                self.assertTrue(store.compare_and_set_ref(name, first, second))
+                self.assertFalse(store.compare_and_set_ref(name, first, first))
+                self.assertEqual(second, store.get_ref(name))
+
+    def test_concurrent_merge(self):
+        store = open_store(self.server.url)
+        cache = SharedCache(store)
+        real_get_ref = store.get_ref
+        raced = []
+
+        def racing_get_ref(name):
+            digest = real_get_ref(name)
+            if not raced:
+                # another runner merges its entry right after this one read the ref
+                raced.append(True)
+                SharedCache(open_store(self.server.url))._merge(
+                    name, [["libother"]], sorted
+                )
+            return digest
+
+        with patch.object(store, "get_ref", racing_get_ref):
+            cache._merge("infeasible/app", [["libfoo"]], sorted)
+        self.assertEqual([["libfoo"], ["libother"]], store.get_json("infeasible/app"))
+
+    def test_rejects_mismatched_digest(self):
+        request = Request(
+            f"{self.server.url}/blobs/{'0' * 64}", data=b"deptective\n", method="PUT"
+        )
+        with self.assertRaises(HTTPError) as context:
+            urlopen(request)
+        self.assertEqual(400, context.exception.code)
+        with self.assertRaises(HTTPError) as context:
+            urlopen(Request(f"{self.server.url}/refs/../x", data=b"", method="PUT"))
+        self.assertEqual(400, context.exception.code)
+
+    def test_database(self):
+        pm = universe().package_manager
+        with TemporaryDirectory() as tmpdir:
+            path = Path(tmpdir) / "packages.sqlite3"
+            cache = SharedCache(open_store(self.server.url))
+            with patch.object(SQLCache, "path", lambda _: path):
+                self.assertFalse(cache.fetch_database(pm))
+                path.write_bytes(b"database")
+                cache.publish_database(pm)
+                path.unlink()
+                self.assertTrue(cache.fetch_database(pm))
+            self.assertEqual(b"database", path.read_bytes())
+
+    def test_shared_resolution(self):
+        cache = SharedCache(open_store(self.server.url))
+        first = SimulatedSBOMGenerator(universe())
+        results = list(first.resolve(["app"]))
+        self.assertEqual([SBOM(("app", "libfoo"))], [r.sbom for r in results])
+        self.assertIn(SBOM(("app", "libfoo-legacy")), first.infeasible)
+        cache.publish(first, [["app"]], results)
+
+        second = SimulatedSBOMGenerator(universe())
+        cache.prepare(second, [["app"]])
+        self.assertEqual(first.infeasible, second.infeasible)
+        self.assertEqual(
+            {"/usr/bin/app": "app", "/usr/lib/libfoo.so": "libfoo"}, second.seed
+        )
+        shared = list(second.resolve(["app"]))
+        self.assertEqual([r.sbom for r in results], [r.sbom for r in shared])
+        self.assertLess(second.nodes_explored, first.nodes_explored)
+
+        # nor does the same command run on a different source tree
+        with TemporaryDirectory() as other_source:
+            other = SharedCache(open_store(self.server.url), Path(other_source))
+            fourth = SimulatedSBOMGenerator(universe())
+            other.prepare(fourth, [["app"]])
+            self.assertFalse(fourth.infeasible)
+            self.assertFalse(fourth.seed)
+
+        # a different command does not share the results
+        third = SimulatedSBOMGenerator(universe())
+        cache.prepare(third, [["app", "--help"]])
+        self.assertFalse(third.infeasible)
+        self.assertFalse(third.seed)
+
+    def test_unreachable(self):
+        cache = SharedCache(HTTPStore("http://127.0.0.1:1", timeout=1))
+        generator = SimulatedSBOMGenerator(universe())
+        # failing to reach the store does not fail the resolution
+        cache.prepare(generator, [["app"]])
+        self.assertEqual(
+            [SBOM(("app", "libfoo"))], [r.sbom for r in generator.resolve(["app"])]
+        )
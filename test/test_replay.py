@@ -0,0 +1,111 @@
+from tempfile import TemporaryDirectory
+from unittest import TestCase
+
+from deptective import apt  # noqa: F401
+from deptective.dependencies import SBOM
+from deptective.package_manager import PackageManager, PackagingConfig
+from deptective.replay import (
+    RecordingStore,
+    ReplaySBOMGenerator,
+    StateRecording,
+    UnrecordedStateError,
+)
+
+ROOT_TRACE = (
+    b'execve("/usr/bin/foo", ["foo"], 0x7ffc /* 8 vars */) = -1 ENOENT (No such file or'
+    b" directory)\n"
+)
+TRACE = (
+    b'execve("/usr/bin/foo", ["foo"], 0x7ffc /* 8 vars */) = 0\n'
+    b'openat(AT_FDCWD, "/usr/lib/libbar.so", O_RDONLY) = -1 ENOENT (No such file or'
+    b" directory)\n"
+)
+
+LIST_INSTALLED = "dpkg-query -W -f '${db:Status-Status} ${binary:Package}\\n'"
+MANIFESTS = {
+    "foo": b"/.\n/usr\n/usr/bin\n/usr/bin/foo\n",
+    "libbar": b"/.\n/usr\n/usr/lib\n/usr/lib/libbar.so\n",
+}
+
+
+def installed(packages) -> bytes:
+    return "".join(f"installed {p}\n" for p in ("base",) + packages).encode("utf-8")
+
+
+def record_session(store: RecordingStore):
+    pm = PackageManager.MANAGERS_BY_NAME["apt"](
+        PackagingConfig(os="ubuntu", os_version="noble", arch="amd64")
+    )
+    store.record_package_manager(pm)
+    store.save(
+        StateRecording(
+            commands=("foo",),
+            packages=(),
+            execs=[
+                ("cp -r /src /workdir", 0, b""),
+                ("apt-get update -y", 0, b""),
+                ("printenv PATH", 0, b"/usr/bin\n"),
+            ],
+            exit_code=127,
+            output=b"foo: command not found\n",
+            trace=ROOT_TRACE,
+        )
+    )
+    for packages, exit_code, output in (
+        (("foo",), 1, b"foo: libbar.so: cannot open shared object file\n"),
+        (("foo", "libbar"), 0, b"hello\n"),
+    ):
+        store.save(
+            StateRecording(
+                commands=("foo",),
+                packages=packages,
+                execs=[
+                    (LIST_INSTALLED, 0, installed(packages[:-1])),
+                    (f"apt-get -y install {packages[-1]}", 0, b""),
+                    (LIST_INSTALLED, 0, installed(packages)),
+                    (f"dpkg -L {packages[-1]}", 0, MANIFESTS[packages[-1]]),
+                ],
+                exit_code=exit_code,
+                output=output,
+                trace=TRACE,
+                files={"/usr/bin/foo": True, "/usr/lib/libbar.so": exit_code == 0},
+            )
+        )
+    store.record_lookup("usr/bin/foo", frozenset({"foo"}))
+    store.record_lookup("usr/lib/libbar.so", frozenset({"libbar"}))
+
+
+class ReplayTests(TestCase):
+    def test_replay(self):
+        with TemporaryDirectory() as tmpdir:
+            record_session(RecordingStore(tmpdir))
+            # reload the recording from disk
+            store = RecordingStore(tmpdir)
+            generator = ReplaySBOMGenerator(store, interactive=False)
+            self.assertEqual([SBOM(("foo", "libbar"))], list(generator.main("foo")))
+            self.assertEqual("apt", generator.cache.package_manager.NAME)
+
+    def test_unrecorded_state(self):
+        with TemporaryDirectory() as tmpdir:
+            store = RecordingStore(tmpdir)
+            record_session(store)
+            generator = ReplaySBOMGenerator(store, interactive=False)
+            with self.assertRaises(UnrecordedStateError):
+                list(generator.main("bar"))
+
+    def test_round_trip(self):
+        state = StateRecording(
+            commands=("make",),
+            packages=("gcc",),
+            execs=[("apt-get -y install gcc", 100, b"\xffno space")],
+            exit_code=2,
+            output=b"",
+            files={"/usr/bin/cc": True},
+        )
+        copy = StateRecording.from_json(state.to_json())
+        self.assertEqual(state, copy)
+        self.assertEqual(state.key, copy.key)
+        self.assertEqual(
+            "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+            copy.output_digest,
+        )
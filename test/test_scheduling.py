@@ -0,0 +1,121 @@
+import threading
+import time
+from pathlib import Path
+from tempfile import TemporaryDirectory
+from unittest import TestCase
+from unittest.mock import MagicMock, patch
+
+from docker.errors import APIError
+from docker.models.images import Image
+
+from deptective.containers import Container
+from deptective.metrics import CONTAINER_QUEUE_DELAY
+from deptective.scheduling import (
+    MIN_MEMORY,
+    HostCapacity,
+    StepScheduler,
+    cpu_ranges,
+)
+
+GIB = 1024**3
+
+
+class SchedulingTests(TestCase):
+    def setUp(self):
+        self.tmpdir = TemporaryDirectory()
+        self.directory = Path(self.tmpdir.name)
+
+    def tearDown(self):
+        self.tmpdir.cleanup()
+
+    def scheduler(self, parallelism: int, cpus: int = 8) -> StepScheduler:
+        scheduler = StepScheduler()
+        scheduler.enable(
+            HostCapacity(cpus=cpus, memory=10 * GIB), parallelism, self.directory
+        )
+        return scheduler
+
+    def test_cpu_ranges(self):
+        self.assertEqual("0-2,5,7-8", cpu_ranges([8, 0, 1, 2, 5, 7]))
+
+    def test_partition(self):
+        slots = StepScheduler.partition(HostCapacity(cpus=8, memory=10 * GIB), 3)
+        self.assertEqual(["0-2", "3-5", "6-7"], [s.cpuset for s in slots])
+        self.assertTrue(all(s.mem_limit == int(8 * GIB / 3) for s in slots))
+        self.assertEqual(
+            {"cpuset_cpus": "0-2", "mem_limit": int(8 * GIB / 3)},
+            slots[0].container_limits(),
+        )
+        # more slots than CPUs share them through quotas
+        slots = StepScheduler.partition(HostCapacity(cpus=2, memory=GIB), 4)
+        self.assertEqual([500_000_000] * 4, [s.nano_cpus for s in slots])
+        self.assertEqual([None] * 4, [s.cpuset for s in slots])
+        self.assertEqual([MIN_MEMORY] * 4, [s.mem_limit for s in slots])
+
+    def test_disabled(self):
+        scheduler = StepScheduler()
+        self.assertIsNone(scheduler.acquire())
+        scheduler.release(None)
+
+    def test_shared_slots(self):
+        # two schedulers stand in for two deptective processes sharing the directory
+        first, second = self.scheduler(1), self.scheduler(1)
+        slot = first.acquire()
+        assert slot is not None
+        # the same thread reuses the slot it holds rather than deadlocking
+        self.assertIs(slot, first.acquire())
+        first.release(slot)
+
+        delays = CONTAINER_QUEUE_DELAY.count()
+        acquired = []
+        waiter = threading.Thread(target=lambda: acquired.append(second.acquire()))
+        waiter.start()
+        time.sleep(0.3)
+        self.assertFalse(acquired)
+        first.release(slot)
+        waiter.join(timeout=5)
+        self.assertEqual(1, len(acquired))
+        self.assertGreater(acquired[0].queue_delay, 0.2)
+        self.assertEqual(delays + 1, CONTAINER_QUEUE_DELAY.count())
+        second.release(acquired[0])
+
+    def test_container_limits(self):
+        client = MagicMock()
+        docker_container = client.containers.create.return_value
+        docker_container.attrs = {"HostConfig": {"LogConfig": {"Type": "json-file"}}}
+        container = Container(MagicMock(spec=Image), client=client)
+        container.start = MagicMock()  # type: ignore
+        container.stop = MagicMock()  # type: ignore
+        scheduler = self.scheduler(2, cpus=4)
+        with patch("deptective.containers.SCHEDULER", scheduler):
+            execution = container.run("true")
+            self.assertEqual(
+                "0-1", client.containers.create.call_args.kwargs["cpuset_cpus"]
+            )
+            self.assertEqual(0, execution.slot.index)  # type: ignore
+            execution.close()
+        self.assertFalse(scheduler._held)
+        container.stop.assert_called_once()
+
+    def test_release_on_error(self):
+        client = MagicMock()
+        docker_container = client.containers.create.return_value
+        docker_container.attrs = {"HostConfig": {"LogConfig": {"Type": "json-file"}}}
+        container = Container(MagicMock(spec=Image), client=client)
+        container.start = MagicMock()  # type: ignore
+        container.stop = MagicMock()  # type: ignore
+        scheduler = self.scheduler(1)
+        with patch("deptective.containers.SCHEDULER", scheduler):
+            execution = container.run("true")
+            docker_container.logs.side_effect = APIError("logs failed")
+            with self.assertRaises(APIError):
+                execution.close()
+            self.assertFalse(scheduler._held)
+            docker_container.remove.assert_called_once()
+            container.stop.assert_called_once()
+
+            # a Docker error while creating the container is not a RuntimeError
+            client.containers.create.side_effect = APIError("create failed")
+            with self.assertRaises(APIError):
+                container.run("true")
+            self.assertFalse(scheduler._held)
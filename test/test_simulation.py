@@ -0,0 +1,198 @@
+import logging
+from typing import Tuple
+from unittest import TestCase
+
+from deptective import apt  # noqa: F401
+from deptective.dependencies import SBOM, Decision
+from deptective.metrics import NODES_PRUNED
+from deptective.simulation import (
+    PackageUniverse,
+    SimulatedSBOMGenerator,
+    SyntheticCommand,
+    SyntheticPackage,
+)
+
+
+class SimulationTests(TestCase):
+    def setUp(self):
+        logging.disable(logging.WARNING)
+
+    def tearDown(self):
+        logging.disable(logging.NOTSET)
+
+    def universe(self) -> PackageUniverse:
+        return PackageUniverse(
+            [
+                SyntheticPackage("app", files=("/usr/bin/app",), depends=("libc",)),
+                SyntheticPackage("libc", files=("/usr/lib/libc.so",)),
+                SyntheticPackage("libfoo", files=("/usr/lib/libfoo.so",)),
+                # claims to provide libfoo.so but does not install it
+                SyntheticPackage("libfoo-doc", indexed_files=("/usr/lib/libfoo.so",)),
+                # provides libfoo.so but cannot be installed
+                SyntheticPackage(
+                    "libfoo-broken",
+                    files=("/usr/lib/libfoo.so",),
+                    installable=False,
+                ),
+            ],
+            [SyntheticCommand("app", ("/usr/lib/libc.so", "/usr/lib/libfoo.so"))],
+        )
+
+    def test_resolution(self):
+        universe = self.universe()
+        generator = SimulatedSBOMGenerator(universe)
+        self.assertEqual([SBOM(("app", "libfoo"))], list(generator.main("app")))
+        # the root, app, and the three libfoo candidates
+        self.assertEqual(5, generator.nodes_explored)
+
+    def test_resolve(self):
+        generator = SimulatedSBOMGenerator(self.universe())
+        results = list(generator.resolve(["app"]))
+        self.assertEqual(1, len(results))
+        result = results[0]
+        self.assertEqual(SBOM(("app", "libfoo")), result.sbom)
+        self.assertEqual(
+            {"app": ("/usr/bin/app",), "libfoo": ("/usr/lib/libfoo.so",)},
+            result.satisfied,
+        )
+        self.assertEqual(0, result.exit_code)
+        # the root, app, and libfoo; libfoo-broken fails to install, and libfoo-doc is
+        # pruned before it is traced because it installs nothing that app accessed
+        self.assertEqual(3, result.steps_explored)
+        self.assertEqual(3, result.images_built)
+        self.assertEqual("app", result.to_json()["packages"][0])
+        self.assertEqual(
+            (
+                Decision("/usr/bin/app", "app"),
+                Decision(
+                    "/usr/lib/libfoo.so", "libfoo", ("libfoo-broken", "libfoo-doc")
+                ),
+            ),
+            result.decisions,
+        )
+
+    def test_manifest_pruning(self):
+        universe = PackageUniverse(
+            [
+                SyntheticPackage("app", files=("/usr/bin/app",)),
+                SyntheticPackage("libfoo", files=("/usr/lib/libfoo.so",)),
+                # provides libfoo.so through a dependency
+                SyntheticPackage(
+                    "libfoo-dev",
+                    indexed_files=("/usr/lib/libfoo.so",),
+                    depends=("libfoo",),
+                ),
+                SyntheticPackage("libfoo-doc", indexed_files=("/usr/lib/libfoo.so",)),
+            ],
+            [SyntheticCommand("app", ("/usr/lib/libfoo.so",))],
+        )
+        generator = SimulatedSBOMGenerator(universe)
+        self.assertEqual(
+            {SBOM(("app", "libfoo")), SBOM(("app", "libfoo-dev"))},
+            set(generator.main("app")),
+        )
+        # libfoo-doc was installed but never traced
+        self.assertEqual(5, generator.nodes_explored)
+        self.assertEqual(4, generator.steps_explored)
+        self.assertEqual(4, generator.images_built)
+
+    def test_manifest_listed_directory(self):
+        def universe(lists):
+            return PackageUniverse(
+                [
+                    SyntheticPackage(
+                        "app", files=("/usr/bin/app", "/usr/lib/app/plugins/core.so")
+                    ),
+                    SyntheticPackage("libfoo", files=("/usr/lib/libfoo.so",)),
+                    # misindexed, and only adds a plugin next to the one app installs
+                    SyntheticPackage(
+                        "foo-plugin",
+                        files=("/usr/lib/app/plugins/foo.so",),
+                        indexed_files=("/usr/lib/libfoo.so",),
+                    ),
+                ],
+                [SyntheticCommand("app", ("/usr/lib/libfoo.so",), lists=lists)],
+            )
+
+        def manifest_prunes(lists) -> float:
+            pruned = NODES_PRUNED.value(rule="manifest")
+            self.assertEqual(
+                [SBOM(("app", "libfoo"))],
+                list(SimulatedSBOMGenerator(universe(lists)).main("app")),
+            )
+            return NODES_PRUNED.value(rule="manifest") - pruned
+
+        # the plugin cannot affect a command that never looks at the plugin directory
+        self.assertEqual(1, manifest_prunes(()))
+        # but a command that lists the directory sees the new plugin, so it is traced
+        self.assertEqual(0, manifest_prunes(("/usr/lib/app/plugins",)))
+
+    def test_subprocess_reruns(self):
+        def universe(created):
+            return PackageUniverse(
+                [
+                    SyntheticPackage(
+                        "make",
+                        files=("/usr/bin/make", "/usr/lib/make/default.mk"),
+                        depends=("gcc",),
+                    ),
+                    SyntheticPackage("gcc", files=("/usr/bin/cc",)),
+                    SyntheticPackage("libfoo-dev", files=("/usr/include/foo.h",)),
+                    # misindexed, and only adds rules that make reads but cc does not
+                    SyntheticPackage(
+                        "make-extras",
+                        files=("/usr/lib/make/extras.mk",),
+                        indexed_files=("/usr/include/foo.h",),
+                    ),
+                ],
+                [
+                    SyntheticCommand(
+                        "make", lists=("/usr/lib/make",), created=created, runs=("cc",)
+                    ),
+                    SyntheticCommand("cc", created + ("/usr/include/foo.h",)),
+                ],
+            )
+
+        def resolve(created) -> Tuple[SimulatedSBOMGenerator, float, float]:
+            subprocess = NODES_PRUNED.value(rule="subprocess")
+            irrelevant = NODES_PRUNED.value(rule="irrelevant")
+            generator = SimulatedSBOMGenerator(universe(created))
+            self.assertEqual(
+                [SBOM(("libfoo-dev", "make"))], list(generator.main("make"))
+            )
+            return (
+                generator,
+                NODES_PRUNED.value(rule="subprocess") - subprocess,
+                NODES_PRUNED.value(rule="irrelevant") - irrelevant,
+            )
+
+        # cc fails the same way on its own, so only it is re-run to test candidates
+        generator, subprocess, irrelevant = resolve(())
+        self.assertEqual((1, 0), (subprocess, irrelevant))
+        # the baseline, and one for each candidate
+        self.assertEqual(3, generator.invocations_run)
+
+        # cc needs a file that make creates and removes, so it fails differently on its
+        # own and each candidate falls back to re-running make
+        generator, subprocess, irrelevant = resolve(("/workdir/conftest.c",))
+        self.assertEqual((0, 1), (subprocess, irrelevant))
+        self.assertEqual(1, generator.invocations_run)
+
+    def test_seed(self):
+        universe = PackageUniverse.generate(packages=200, depth=3, providers=2)
+        results = list(SimulatedSBOMGenerator(universe).resolve(["app"]))
+        self.assertEqual(8, len(results))
+        last = results[-1]
+        generator = SimulatedSBOMGenerator(universe)
+        generator.add_seed(Decision.from_json(d) for d in last.to_json()["decisions"])
+        first = next(iter(generator.resolve(["app"])))
+        self.assertEqual(last.sbom, first.sbom)
+        self.assertEqual(last.decisions, first.decisions)
+        self.assertLess(first.steps_explored, last.steps_explored)
+
+    def test_generate(self):
+        universe = PackageUniverse.generate(packages=200, depth=3, providers=2)
+        self.assertEqual(3, len(universe.commands["app"].requires))
+        results = list(SimulatedSBOMGenerator(universe).main("app"))
+        # two providers for each of the three required files
+        self.assertEqual(8, len(results))
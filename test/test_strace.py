@@ -1,6 +1,40 @@
 from unittest import TestCase
 
-from deptective.strace import Arg, ListArg, parse_strace_log_line, parse_syscall_args
+from deptective.strace import (
+    Arg,
+    Invocation,
+    ListArg,
+    ProcessTree,
+    parse_strace_log_line,
+    parse_syscall_args,
+)
+
+from strace_corpus import parse_line, read_golden, read_trace, trace_names
+
+MAKE_TRACE = """\
+100   execve("/usr/bin/make", ["make"], ["PATH=/usr/bin:/bin", "HOME=/root"]) = 0
+100   openat(AT_FDCWD, "Makefile", O_RDONLY) = 3
+100   clone(child_stack=NULL, flags=CLONE_CHILD_CLEARTID|SIGCHLD <unfinished ...>
+101   chdir("src") = 0
+100   <... clone resumed>, child_tidptr=0x7f0000000a10) = 101
+101   execve("/bin/sh", ["/bin/sh", "-c", "cc -c foo.c"], ["PATH=/usr/bin:/bin"]) = 0
+101   vfork( <unfinished ...>
+102   execve("/usr/local/bin/cc", ["cc", "-c", "foo.c"], ["PATH=/usr/bin:/bin"]) = -1 \
+ENOENT (No such file or directory)
+102   execve("/usr/bin/cc", ["cc", "-c", "foo.c"], ["PATH=/usr/bin:/bin"]) = 0
+101   <... vfork resumed>)              = 102
+102   vfork()                           = 103
+103   execve("/usr/lib/gcc/cc1", ["cc1", "foo.c", "-o", "/tmp/cc0.s"], []) = 0
+103   openat(AT_FDCWD, "zlib.h", O_RDONLY) = -1 ENOENT (No such file or directory)
+103   openat(AT_FDCWD, "/usr/include/zlib.h", O_RDONLY) = -1 ENOENT (No such file or \
+directory)
+103   exit_group(1)                     = ?
+103   +++ exited with 1 +++
+102   --- SIGCHLD {si_signo=SIGCHLD, si_code=CLD_EXITED, si_pid=103, si_status=1} ---
+102   +++ exited with 1 +++
+101   +++ exited with 1 +++
+100   +++ exited with 2 +++
+"""
 
 
 class TestStrace(TestCase):
@@ -43,3 +77,68 @@ class TestStrace(TestCase):
         self.assertIsNone(syscall)
         self.assertEqual((), tuple(args))
         self.assertEqual(1, retval)
+
+    def test_corpus(self):
+        names = trace_names()
+        self.assertTrue(names)
+        for name in names:
+            with self.subTest(trace=name):
+                lines = read_trace(name)
+                golden = list(read_golden(name))
+                self.assertEqual(len(golden), len(lines))
+                for (lineno, expected), line in zip(golden, lines):
+                    self.assertEqual(
+                        expected, parse_line(line), f"{name}.strace.gz:{lineno}"
+                    )
+
+    def test_process_tree(self):
+        tree = ProcessTree.from_lines(MAKE_TRACE.splitlines(), cwd="/workdir")
+        self.assertEqual(4, len(tree.processes))
+        cc1 = tree.processes[103]
+        self.assertEqual(102, cc1.parent.pid)
+        self.assertEqual("/workdir/src", cc1.cwd)
+        self.assertEqual(
+            {"/workdir/src/zlib.h", "/usr/include/zlib.h"}, set(cc1.missing)
+        )
+        # the compiler's back end depends on its driver, and the driver is run by the
+        # shell, which is preferred as the outermost failing process other than make
+        self.assertEqual(
+            Invocation(
+                executable="/bin/sh",
+                argv=("/bin/sh", "-c", "cc -c foo.c"),
+                cwd="/workdir/src",
+                env=("PATH=/usr/bin:/bin",),
+                exit_code=1,
+                missing_files=frozenset(
+                    {
+                        "/usr/local/bin/cc",
+                        "/workdir/src/zlib.h",
+                        "/usr/include/zlib.h",
+                    }
+                ),
+            ),
+            tree.failing_invocation(["/usr/include/zlib.h"]),
+        )
+        # no subprocess looked for a file that is actually missing
+        self.assertIsNone(tree.failing_invocation(["/usr/lib/libz.so"]))
+
+    def test_process_tree_subshell(self):
+        # a forked subshell has not called execve, so re-running it would re-run the
+        # whole command
+        tree = ProcessTree.from_lines(
+            [
+                '1 execve("/bin/sh", ["sh", "./configure"], ["A=1"]) = 0',
+                "1 fork() = 2",
+                "2 fork() = 3",
+                '3 execve("/usr/bin/gcc", ["gcc", "conftest.c"], ["A=1"]) = 0',
+                '3 openat(AT_FDCWD, "/usr/include/z.h", O_RDONLY) = -1 ENOENT (No'
+                " such file or directory)",
+                "3 +++ exited with 1 +++",
+                "2 +++ exited with 1 +++",
+                "1 +++ exited with 1 +++",
+            ]
+        )
+        invocation = tree.failing_invocation(["/usr/include/z.h"])
+        self.assertIsNotNone(invocation)
+        self.assertEqual(("gcc", "conftest.c"), invocation.argv)
+        self.assertEqual("/workdir", invocation.cwd)